@@ -0,0 +1,1938 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "TimerTypes.hpp"
+#include "TimerCalendar.hpp"
+#include "TimerPolicies.hpp"
+#include "TimerQueues.hpp"
+#include "TimerSnapshot.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Off Linux, the scheduler thread sleeps on a condition variable instead of a futex
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#define BASIC_TIMER_SCHEDULER_FUTEX 1
+#endif
+
+// Timer scheduler configured at compile time through policies:
+//   Clock     a std::chrono clock (e.g. steady_clock, or a simulated clock)
+//   Queue     deadline queue, see TimerQueues.hpp (e.g. MultimapQueue, FixedHeapQueue<N>)
+//   Lock      mutex type; NullLock compiles locking out for single-threaded use
+//   Callback  callable invoked with the TimerHandle (e.g. std::function, a function pointer)
+//   Executor  invokes the callbacks, see TimerPolicies.hpp (e.g. InlineCallbackExecutor)
+//   Tracer    records scheduler activity, see TimerPolicies.hpp (NullTracer, or TimerTrace::RingTracer)
+//   WallClock clock of calendar timers, with system_clock time points (see addCalendarTimer)
+// Nothing is virtual, so the policies inline. The scheduler either runs its own thread (run()),
+// or is driven from the owner's loop (start() + processTimeouts(), with nextTimeout() telling
+// how long the loop may sleep).
+template<typename Clock, typename Queue, typename Lock, typename Callback, typename Executor, typename Tracer = NullTracer, typename WallClock = std::chrono::system_clock>
+class BasicTimerScheduler
+{
+    static_assert(std::is_same<typename WallClock::time_point, TimerCalendar::WallTimePoint>::value, "WallClock must use system_clock time points");
+
+public:
+    using TimerHandle = TimerTypes::TimerHandle;
+    using TimerGroup = TimerTypes::TimerGroup;
+    using TimerMode = TimerTypes::TimerMode;
+    using TimerOptions = TimerTypes::TimerOptions;
+    using JitterMode = TimerTypes::JitterMode;
+    using CancelMode = TimerTypes::CancelMode;
+    using GroupStatistics = TimerTypes::GroupStatistics;
+    using TimerPriority = TimerTypes::TimerPriority;
+    using PriorityStatistics = TimerTypes::PriorityStatistics;
+    using TimePoint = typename Clock::time_point;
+    using Duration = typename Clock::duration;
+    using SchedulerStatus = TimerTypes::SchedulerStatus<TimePoint>;
+    using StopOptions = TimerTypes::StopOptions;
+    using CronExpression = TimerCalendar::CronExpression;
+
+    // While there are calendar timers, the scheduler thread wakes at least this often to check for wall-clock steps
+    static constexpr std::chrono::seconds kClockStepCheckInterval{1};
+
+    explicit BasicTimerScheduler(std::pmr::memory_resource* upstream = std::pmr::get_default_resource(), Executor executor = Executor(), Tracer tracer = Tracer()) :
+        mUpstream(upstream),
+        mReserve(upstream),
+        mNodePool(std::pmr::pool_options{kPoolChunkNodes, 0}, &mReserve),
+        mQueue(&mNodePool),
+        mExtras(&mNodePool),
+        mFreeExtras(&mNodePool),
+        mGroups(&mNodePool),
+        mCalendars(&mNodePool),
+        mRandomState(reinterpret_cast<uintptr_t>(this) ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())),
+        mExecutor(std::move(executor)),
+        mTracer(std::move(tracer))
+    {
+    }
+
+    BasicTimerScheduler(const BasicTimerScheduler&) = delete;
+    BasicTimerScheduler& operator=(const BasicTimerScheduler &) = delete;
+    BasicTimerScheduler(BasicTimerScheduler &&) = delete;
+    BasicTimerScheduler & operator=(BasicTimerScheduler &&) = delete;
+
+    ~BasicTimerScheduler()
+    {
+        reset();
+        for(size_t chunk = 0; chunk < mChunkCount; ++chunk)
+        {
+            Timer* const timers = mTimerChunks[chunk].load(std::memory_order_relaxed);
+            Callback* const callbacks = mCallbackChunks[chunk];
+            const size_t chunkSize = chunkSizeOf(chunk);
+            for(size_t i = 0; i < chunkSize; ++i)
+            {
+                timers[i].~Timer();
+                callbacks[i].~Callback();
+            }
+            mUpstream->deallocate(timers, chunkSize * sizeof(Timer), alignof(Timer));
+            mUpstream->deallocate(callbacks, chunkSize * sizeof(Callback), alignof(Callback));
+        }
+    }
+
+    // Set allocation for timer data storage; only has an affect if the scheduler is not running.
+    // Afterwards, up to anticipatedNumberOfTimers timers are handled without further allocation.
+    // With hardCapacity, addTimer returns 0 instead of growing beyond anticipatedNumberOfTimers.
+    void reserve(size_t anticipatedNumberOfTimers, bool hardCapacity = false)
+    {
+        std::lock_guard<Lock> lock(mMutex);
+        if(mState == State::Off)
+        {
+            const size_t capacity = std::min({anticipatedNumberOfTimers, kMaxSlots, Queue::kCapacity});
+
+            // Allocate the timer table chunks up front, with room for the slots held back from reuse
+            const size_t slots = hardCapacity ? capacity : std::min({capacity + kReuseDelay, kMaxSlots, Queue::kCapacity});
+            while(mSlotCapacity < slots)
+            {
+                addTimerChunk();
+            }
+
+            mQueue.reserve(capacity);
+
+            // The side table of rare fields too; its pages are only touched as timers take records
+            mExtras.reserve(capacity);
+            mFreeExtras.reserve(capacity);
+
+            mTimedOutTimers.reserve(capacity);
+            mSortedTimers.reserve(capacity);
+            mTombstones.reserve(capacity);
+
+            // One block for the queue's nodes, which the pool takes in chunks of up to kPoolChunkNodes
+            // (plus a little bookkeeping); group and calendar records come from what is left over
+            if(Queue::kNodeBytes > 0)
+            {
+                mReserve.reserve((capacity + 2 * kPoolChunkNodes) * (Queue::kNodeBytes + 1));
+            }
+
+            mSlotLimit = hardCapacity ? capacity : std::min(kMaxSlots, Queue::kCapacity);
+        }
+    }
+
+    // Start the scheduler with its own thread.
+    void run()
+    {
+        static_assert(!std::is_same<Lock, NullLock>::value, "A scheduler without locking must be driven with start() and processTimeouts()");
+
+        std::lock_guard<Lock> lock(mMutex);
+        if(mState == State::Off)
+        {
+            // A stop called from a callback leaves the (finished) thread to be joined
+            if(mThread.joinable())
+            {
+                mThread.join();
+            }
+            mThread = std::thread([this] { timerThreadLoop(); });
+            mState = State::Running;
+            publishStatus();
+        }
+    }
+
+    // Start the scheduler without a thread; timeouts are processed by calling processTimeouts().
+    void start()
+    {
+        std::lock_guard<Lock> lock(mMutex);
+        if(mState == State::Off)
+        {
+            mState = State::Running;
+            publishStatus();
+        }
+    }
+
+    // Stop the scheduler; see StopOptions for draining the timers due within a grace period, and for
+    // keeping the timers. This may also be called from within a timeout callback: the stop then
+    // completes once the callback has returned (after the drain), and the scheduler thread is joined
+    // by the next run(), stop() or reset(). A scheduler driven with processTimeouts() stops once the
+    // owner's loop has fired the timers to drain (or right away if there are none).
+    // Otherwise this returns once the scheduler has stopped.
+    void stop(const StopOptions& options = StopOptions())
+    {
+        std::unique_lock<Lock> lock(mMutex);
+        if(mState == State::Running)
+        {
+            mStopKeepsTimers = options.keepTimers;
+            mDrainDeadline = (options.drainPeriod.count() > 0) ? toDeadline(queueTime(Clock::now()) + std::chrono::ceil<Duration>(options.drainPeriod)) : kNoDrain;
+            mState = State::Stopping; // transition to Stopping state; signals the thread to stop once drained
+            publishStatus();
+        }
+        else if(mState == State::Stopping && options.drainPeriod.count() == 0)
+        {
+            // Stopping right away ends a drain in progress
+            mStopKeepsTimers = mStopKeepsTimers && options.keepTimers;
+            mDrainDeadline = kNoDrain;
+        }
+
+        if(mThread.joinable())
+        {
+            // This can only wait from another thread
+            if(std::this_thread::get_id() == mThread.get_id())
+            {
+                return;
+            }
+
+            // wake up the thread (will still be blocked by mutex until after the lock is released below)
+            wakeThread();
+            lock.unlock();
+
+            // Unlock the lock and wait for the thread to finish
+            mThread.join();
+
+            lock.lock();
+        }
+        else if(!mDispatching)
+        {
+            finishStopIfDrained();
+        }
+
+        // Also removes timers kept by an earlier stop
+        if(mState == State::Off && !options.keepTimers)
+        {
+            releaseAllTimers();
+            publishStatus();
+        }
+    }
+
+    // Stop the scheduler and remove all timers (see stop()).
+    void reset()
+    {
+        stop(StopOptions());
+    }
+
+    // Stop firing timers without removing them. Time stands still for the timers while paused (timers
+    // added meanwhile count from the resume): resume() shifts every deadline by the time spent paused
+    // at once, by moving the queue's time base rather than re-keying the queue, so that e.g. a standby
+    // taking over after a failover does not have to reload its timers.
+    void pause()
+    {
+        std::lock_guard<Lock> lock(mMutex);
+        if(!mPaused)
+        {
+            mPaused = true;
+            mPausedAt = Clock::now();
+            publishStatus();
+        }
+    }
+
+    // Continue firing timers after pause() (or after a stop that kept them, once started again).
+    void resume()
+    {
+        {
+            std::lock_guard<Lock> lock(mMutex);
+            if(!mPaused)
+            {
+                return;
+            }
+            mTimeShift += Clock::now() - mPausedAt;
+            mPaused = false;
+            publishStatus();
+        }
+
+        // wake up thread to adjust timeout
+        wakeThread();
+    }
+
+    // Add a timer; returns 0 if the scheduler is not running or is full. Calendar timers are added
+    // with addCalendarTimer().
+    template<typename Rep, typename Period>
+    TimerHandle addTimer(const std::chrono::duration<Rep, Period>& period, Callback callback, const TimerOptions& options = TimerOptions())
+    {
+        if(options.mode == TimerMode::Calendar)
+        {
+            return 0;
+        }
+
+        const Duration timerPeriod = std::chrono::ceil<Duration>(period);
+
+        // Get the time immediately (before locking mutex)
+        const TimePoint now = Clock::now();
+
+        // Deadline (of Clock) to wake the thread for, if it sleeps past it
+        Deadline wakeDeadline(kNoWake);
+
+        TimerHandle handle(0);
+
+        {
+            std::lock_guard<Lock> lock(mMutex);
+
+            if(mState == State::Running)
+            {
+                const Slot slot = allocateSlot();
+                if(slot != kInvalidSlot)
+                {
+                    Timer& timer = timerAt(slot);
+                    timer.period = timerPeriod;
+                    timer.jitter = options.jitter;
+                    if(options.jitter != JitterMode::None || options.mode == TimerMode::Backoff || options.callbackKey != 0 || options.group != 0)
+                    {
+                        TimerExtras& extras = acquireExtras(timer);
+                        extras.lastInterval = timerPeriod;
+                        extras.jitterFraction = options.jitterFraction;
+                        extras.backoffDelay = timerPeriod;
+                        extras.backoffCap = (options.backoffCap.count() > 0) ? std::chrono::ceil<Duration>(options.backoffCap) : Duration::max();
+                        extras.backoffMultiplier = options.backoffMultiplier;
+                        extras.maxAttempts = options.maxAttempts;
+                        extras.callbackKey = options.callbackKey;
+                    }
+                    if(mQueue.push(toDeadline(queueTime(now) + nextInterval(timer, timerPeriod)), slot))
+                    {
+                        callbackAt(slot) = std::move(callback);
+                        timer.mode = options.mode;
+                        timer.priority = options.priority;
+                        timer.group = options.group;
+                        linkIntoGroup(slot);
+                        handle = static_cast<TimerHandle>(timer.state.load(std::memory_order_relaxed));
+                        mTracer.record(TimerTypes::TraceEvent::Add, handle, std::chrono::duration_cast<std::chrono::nanoseconds>(timerPeriod).count(), options.mode);
+
+                        if(mQueue.top() == slot)
+                        {
+                            wakeDeadline = toDeadline(clockTime(mQueue.topDeadline()));
+                        }
+                    }
+                    else
+                    {
+                        releaseSlot(slot); // queue is full
+                    }
+                    publishStatus();
+                }
+            }
+        }
+
+        // wake up thread to adjust timeout
+        wakeThread(wakeDeadline);
+
+        return handle;
+    }
+
+    // Add a timer that fires at the wall-clock times of a calendar expression (see TimerCalendar.hpp).
+    // Each next time is computed from the previous one when the timer fires (occurrences missed
+    // while the scheduler was late are skipped). Wall-clock steps are detected within
+    // kClockStepCheckInterval, and only calendar timers are then re-keyed: times that the clock
+    // jumped past fire once right away, the others are recomputed from the new wall-clock time.
+    // The options' mode and jitter are ignored. Returns 0 if the expression matches no future time.
+    TimerHandle addCalendarTimer(const CronExpression& expression, Callback callback, const TimerOptions& options = TimerOptions())
+    {
+        const TimePoint now = Clock::now();
+        const std::optional<TimerCalendar::WallTimePoint> next = expression.next(WallClock::now());
+        if(!next)
+        {
+            return 0;
+        }
+
+        // Deadline (of Clock) to wake the thread for, if it sleeps past it
+        Deadline wakeDeadline(kNoWake);
+
+        TimerHandle handle(0);
+
+        {
+            std::lock_guard<Lock> lock(mMutex);
+
+            if(mState == State::Running)
+            {
+                const Slot slot = allocateSlot();
+                if(slot != kInvalidSlot)
+                {
+                    const std::chrono::nanoseconds offset = wallClockOffset();
+                    const Deadline deadline = calendarDeadline(*next, offset);
+                    if(mQueue.push(deadline, slot))
+                    {
+                        if(mCalendars.empty())
+                        {
+                            mWallClockOffset = offset;
+                        }
+                        Timer& timer = timerAt(slot);
+                        TimerExtras& extras = acquireExtras(timer);
+                        extras.calendar = static_cast<uint32_t>(mCalendars.size());
+                        extras.callbackKey = options.callbackKey;
+                        mCalendars.push_back(CalendarEntry{expression, *next, slot});
+                        callbackAt(slot) = std::move(callback);
+                        timer.mode = TimerMode::Calendar;
+                        timer.priority = options.priority;
+                        timer.jitter = JitterMode::None;
+                        timer.group = options.group;
+                        linkIntoGroup(slot);
+                        handle = static_cast<TimerHandle>(timer.state.load(std::memory_order_relaxed));
+                        mTracer.record(TimerTypes::TraceEvent::Add, handle, std::chrono::duration_cast<std::chrono::nanoseconds>(clockTime(deadline) - now).count(), TimerMode::Calendar);
+
+                        if(mQueue.top() == slot)
+                        {
+                            wakeDeadline = toDeadline(clockTime(mQueue.topDeadline()));
+                        }
+                    }
+                    else
+                    {
+                        releaseSlot(slot); // queue is full
+                    }
+                    publishStatus();
+                }
+            }
+        }
+
+        // wake up thread to adjust timeout
+        wakeThread(wakeDeadline);
+
+        return handle;
+    }
+
+    void removeTimer(TimerHandle handle)
+    {
+        if(mCancelMode.load(std::memory_order_relaxed) == CancelMode::Lazy)
+        {
+            // Only mark the timer as a tombstone; the scheduler thread removes it later
+            Timer* const timer = findTimerUnlocked(handle);
+            if(timer != nullptr)
+            {
+                const uint32_t expected = static_cast<uint32_t>(handle);
+                if(markTombstone(*timer, expected))
+                {
+                    mTracer.record(TimerTypes::TraceEvent::Cancel, handle);
+
+                    // A dormant timer never reaches the head of the queue, so it is released right away
+                    if(timer->dormant.load(std::memory_order_seq_cst))
+                    {
+                        std::lock_guard<Lock> lock(mMutex);
+                        if(timer->state.load(std::memory_order_relaxed) == (expected | kTombstoneBit) && timer->dormant.load(std::memory_order_relaxed))
+                        {
+                            const Slot slot = static_cast<Slot>(handle) & kSlotMask;
+                            unlinkFromGroup(slot, true);
+                            releaseSlot(slot);
+                        }
+                    }
+                }
+            }
+            return;
+        }
+
+        // The thread is not woken: it wakes for the removed timer's deadline at the latest, and then
+        // goes back to sleep until the next one
+        std::lock_guard<Lock> lock(mMutex);
+
+        // The handle encodes the slot, so no lookup is needed; a stale handle fails the generation check.
+        const Slot slot = findSlot(handle);
+        if(slot != kInvalidSlot)
+        {
+            mTracer.record(TimerTypes::TraceEvent::Cancel, handle);
+            removeFromQueue(slot);
+            unlinkFromGroup(slot, true);
+            releaseSlot(slot);
+            publishStatus();
+        }
+    }
+
+    // Move a timer's next deadline to delay from now, keeping its handle and period; this also re-arms a
+    // dormant Manual timer. Returns false if the handle is stale (or a backoff timer's callback is running).
+    template<typename Rep, typename Period>
+    bool rescheduleTimer(TimerHandle handle, const std::chrono::duration<Rep, Period>& delay)
+    {
+        const TimePoint now = Clock::now();
+
+        Deadline wakeDeadline(kNoWake);
+        bool rescheduled(false);
+
+        {
+            std::lock_guard<Lock> lock(mMutex);
+
+            const Slot slot = findSlot(handle);
+            if(slot != kInvalidSlot && !timerAt(slot).rearmPending)
+            {
+                // Re-keying in place: no slot, callback or group churn
+                Timer& timer = timerAt(slot);
+                removeFromQueue(slot);
+                timer.dormant.store(false, std::memory_order_relaxed);
+                mQueue.push(toDeadline(queueTime(now) + std::chrono::ceil<Duration>(delay)), slot);
+                mTracer.record(TimerTypes::TraceEvent::Reschedule, handle, std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count());
+                if(mQueue.top() == slot)
+                {
+                    wakeDeadline = toDeadline(clockTime(mQueue.topDeadline()));
+                }
+                rescheduled = true;
+                publishStatus();
+            }
+        }
+
+        // wake up thread to adjust timeout (only if it would sleep past the new deadline)
+        wakeThread(wakeDeadline);
+
+        return rescheduled;
+    }
+
+    // Set how removeTimer() cancels timers (default is Eager); may be changed at any time.
+    void setCancelMode(CancelMode mode, float compactionThreshold = 0.25f)
+    {
+        std::lock_guard<Lock> lock(mMutex);
+        mCompactionThreshold = compactionThreshold;
+        mCancelMode.store(mode, std::memory_order_relaxed);
+    }
+
+    // Remove all timers of a group in a single pass; returns the number of timers removed.
+    size_t cancelGroup(TimerGroup group)
+    {
+        size_t removedTimers(0);
+
+        {
+            std::lock_guard<Lock> lock(mMutex);
+
+            const auto groupIter = mGroups.find(group);
+            if(groupIter != mGroups.end())
+            {
+                // Walk the group's intrusive list; the whole list is dropped afterwards, so the links
+                // do not need to be maintained along the way. The record keeps the statistics.
+                Group& record = groupIter->second;
+                Slot slot = record.head;
+                while(slot != kInvalidSlot)
+                {
+                    const Slot nextSlot = extrasOf(timerAt(slot)).groupNext;
+                    mTracer.record(TimerTypes::TraceEvent::Cancel, static_cast<TimerHandle>(timerAt(slot).state.load(std::memory_order_relaxed) & ~kTombstoneBit));
+                    removeFromQueue(slot);
+                    releaseSlot(slot);
+                    ++removedTimers;
+                    slot = nextSlot;
+                }
+                record.head = kInvalidSlot;
+                record.statistics.activeTimers = 0;
+                record.statistics.cancelledTimers += removedTimers;
+                publishStatus();
+            }
+        }
+
+        return removedTimers;
+    }
+
+    // Get the statistics of a priority class since the scheduler was started.
+    PriorityStatistics priorityStatistics(TimerPriority priority)
+    {
+        std::lock_guard<Lock> lock(mMutex);
+        return mPriorityStatistics[static_cast<size_t>(priority)];
+    }
+
+    // Get the statistics of a group since its first timer was added (or since clearGroupStatistics());
+    // all zero for a group that never had timers. They are kept after the group's timers are gone.
+    GroupStatistics groupStatistics(TimerGroup group)
+    {
+        std::lock_guard<Lock> lock(mMutex);
+
+        const auto groupIter = mGroups.find(group);
+        if(groupIter != mGroups.end())
+        {
+            return groupIter->second.statistics;
+        }
+        return GroupStatistics();
+    }
+
+    // Reset the counters of a group, and drop its record if it has no timers; groups used once (e.g.
+    // per session) should be cleared when done with, since their records are kept until then.
+    void clearGroupStatistics(TimerGroup group)
+    {
+        std::lock_guard<Lock> lock(mMutex);
+
+        const auto groupIter = mGroups.find(group);
+        if(groupIter != mGroups.end())
+        {
+            GroupStatistics& statistics = groupIter->second.statistics;
+            if(statistics.activeTimers == 0)
+            {
+                mGroups.erase(groupIter);
+            }
+            else
+            {
+                statistics = GroupStatistics{statistics.activeTimers, 0, 0, 0};
+            }
+        }
+    }
+
+    // Write all timers that have a callback key to a snapshot file (see TimerSnapshot.hpp), with
+    // their handle, remaining time, period, mode and group; dormant Manual timers are written with
+    // the kDormant flag, and restored dormant. Returns false if writing failed.
+    bool snapshot(const char* path)
+    {
+        std::vector<TimerSnapshot::Entry> entries;
+        {
+            std::lock_guard<Lock> lock(mMutex);
+
+            const Deadline now = toDeadline(queueTime(Clock::now()));
+            const auto appendEntry = [this, &entries](Slot slot, int64_t remainingNanoseconds, uint8_t flags)
+            {
+                const Timer& timer = timerAt(slot);
+                const uint32_t state = timer.state.load(std::memory_order_relaxed);
+                // Backoff timers are not snapshotted, their retry state being transient; nor are calendar
+                // timers, whose expressions do not fit an entry
+                if(timer.extras != kNoExtras && extrasOf(timer).callbackKey != 0 && (state & kTombstoneBit) == 0 && timer.mode != TimerMode::Backoff && timer.mode != TimerMode::Calendar)
+                {
+                    const TimerExtras& extras = extrasOf(timer);
+                    TimerSnapshot::Entry entry = {};
+                    entry.remainingNanoseconds = remainingNanoseconds;
+                    entry.periodNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(timer.period).count();
+                    entry.callbackKey = extras.callbackKey;
+                    entry.handle = static_cast<TimerHandle>(state);
+                    entry.group = timer.group;
+                    entry.mode = static_cast<uint8_t>(timer.mode);
+                    entry.jitter = static_cast<uint8_t>(timer.jitter);
+                    entry.priority = static_cast<uint8_t>(timer.priority);
+                    entry.flags = flags;
+                    entry.jitterFraction = extras.jitterFraction;
+                    entries.push_back(entry);
+                }
+            };
+            entries.reserve(mQueue.size());
+            mQueue.forEach([now, &appendEntry](Slot slot, Deadline deadline)
+            {
+                appendEntry(slot, std::chrono::duration_cast<std::chrono::nanoseconds>(Duration(deadline - now)).count(), 0);
+            });
+            // Dormant timers are out of the queue
+            for(size_t slot = 0; slot < mSlotCount; ++slot)
+            {
+                const Timer& timer = timerAt(static_cast<Slot>(slot));
+                if(timer.state.load(std::memory_order_relaxed) != 0 && timer.dormant.load(std::memory_order_relaxed))
+                {
+                    appendEntry(static_cast<Slot>(slot), 0, TimerSnapshot::kDormant);
+                }
+            }
+        }
+
+        // Not every queue iterates in deadline order; restore relies on it
+        std::stable_sort(entries.begin(), entries.end(), [](const TimerSnapshot::Entry& left, const TimerSnapshot::Entry& right)
+        {
+            return left.remainingNanoseconds < right.remainingNanoseconds;
+        });
+        return TimerSnapshot::writeFile(path, entries.data(), entries.size());
+    }
+
+    // Restore the timers of a snapshot file into a running scheduler that has no timers, keeping
+    // their handles; callbacks are looked up by key in the registry (timers with unknown keys are
+    // skipped). The queue is bulk-loaded in linear time; dormant timers are restored dormant, to be
+    // rescheduled. Returns the number of timers restored.
+    size_t restore(const char* path, const TimerCallbackRegistry<Callback>& registry)
+    {
+        const TimerSnapshot::MappedFile file(path);
+        if(!file.valid())
+        {
+            return 0;
+        }
+
+        size_t restoredTimers(0);
+        {
+            std::lock_guard<Lock> lock(mMutex);
+
+            if(mState != State::Running || !mQueue.empty())
+            {
+                return 0;
+            }
+
+            const TimePoint now = queueTime(Clock::now());
+            for(size_t i = 0; i < file.entryCount(); ++i)
+            {
+                const TimerSnapshot::Entry& entry = file.entries()[i];
+                const Slot slot = static_cast<Slot>(entry.handle) & kSlotMask;
+                const Callback* const callback = registry.find(entry.callbackKey);
+                // snapshot() writes neither backoff nor calendar timers; other modes and jitter modes
+                // beyond the known ones come from a corrupt (or newer) file
+                const bool knownMode = entry.mode == static_cast<uint8_t>(TimerMode::Periodic) || entry.mode == static_cast<uint8_t>(TimerMode::OneShot) || entry.mode == static_cast<uint8_t>(TimerMode::Manual);
+                const bool dormant = file.version() >= 3 && (entry.flags & TimerSnapshot::kDormant) != 0;
+                if(entry.handle <= 0 || slot >= mSlotLimit || callback == nullptr || !knownMode || entry.jitter > static_cast<uint8_t>(JitterMode::Decorrelated) ||
+                   (dormant && entry.mode != static_cast<uint8_t>(TimerMode::Manual)))
+                {
+                    continue;
+                }
+
+                while(mSlotCapacity <= slot)
+                {
+                    addTimerChunk();
+                }
+                mSlotCount = std::max(mSlotCount, size_t(slot) + 1);
+
+                Timer& timer = timerAt(slot);
+                if(timer.state.load(std::memory_order_relaxed) != 0 || timer.firing)
+                {
+                    continue; // duplicate slot in a corrupt file, or a slot whose callback still runs (its release is deferred)
+                }
+                const Duration remaining = std::chrono::duration_cast<Duration>(std::chrono::nanoseconds(entry.remainingNanoseconds));
+                if(!dormant && !mQueue.pushBack(toDeadline(now + remaining), slot))
+                {
+                    break; // queue is full
+                }
+                timer.dormant.store(dormant, std::memory_order_relaxed);
+                timer.generation = static_cast<uint32_t>(entry.handle) >> kSlotBits;
+                timer.state.store(static_cast<uint32_t>(entry.handle), std::memory_order_release);
+                callbackAt(slot) = *callback;
+                timer.period = std::chrono::duration_cast<Duration>(std::chrono::nanoseconds(entry.periodNanoseconds));
+                timer.mode = static_cast<TimerMode>(entry.mode);
+                timer.priority = (file.version() >= 2 && entry.priority < TimerTypes::kPriorityClasses) ? static_cast<TimerPriority>(entry.priority) : TimerPriority::Normal;
+                timer.jitter = static_cast<JitterMode>(entry.jitter);
+                timer.group = entry.group;
+                timer.extras = kNoExtras; // a free slot's is its free list link; the list is rebuilt below
+                TimerExtras& extras = acquireExtras(timer);
+                extras.lastInterval = timer.period;
+                extras.jitterFraction = entry.jitterFraction;
+                extras.callbackKey = entry.callbackKey;
+                linkIntoGroup(slot);
+                ++restoredTimers;
+            }
+
+            // Rebuild the free list from the slots that were not restored; a slot still firing joins it
+            // once its callback has returned
+            mFreeSlotsHead = kInvalidSlot;
+            mFreeSlotsTail = kInvalidSlot;
+            mFreeSlotCount = 0;
+            for(size_t slot = 0; slot < mSlotCount; ++slot)
+            {
+                const Timer& timer = timerAt(static_cast<Slot>(slot));
+                if(timer.state.load(std::memory_order_relaxed) == 0 && !timer.firing)
+                {
+                    appendToFreeList(static_cast<Slot>(slot));
+                }
+            }
+            publishStatus();
+        }
+
+        wakeThread();
+
+        return restoredTimers;
+    }
+
+    // Fire all timers that are due; returns the number of callbacks invoked. Used to drive a
+    // scheduler started with start(); must not be called on one that runs its own thread.
+    size_t processTimeouts()
+    {
+        return checkForTimeouts() ? mTimedOutTimers.size() : 0;
+    }
+
+    // The time the next timer is due, if any (none while paused).
+    std::optional<TimePoint> nextTimeout()
+    {
+        std::lock_guard<Lock> lock(mMutex);
+        finishStopIfDrained();
+        dropTombstonesAtHead();
+        if(mQueue.empty() || mPaused || mState == State::Off)
+        {
+            return std::nullopt;
+        }
+        return boundedTimeout(clockTime(mQueue.topDeadline()));
+    }
+
+    // The scheduler's state, queued timers, next deadline and fired callbacks, as one consistent
+    // snapshot read without locking: the scheduler publishes it through a seqlock whenever they
+    // change, so monitoring does not contend with adding and firing timers. A read only retries
+    // while a publish (a few stores) is in progress.
+    SchedulerStatus status() const
+    {
+        SchedulerStatus status;
+        uint32_t sequence;
+        do
+        {
+            sequence = mStatus.sequence.load(std::memory_order_acquire);
+            status.running = mStatus.running.load(std::memory_order_acquire);
+            status.paused = mStatus.paused.load(std::memory_order_acquire);
+            status.queuedTimers = mStatus.queuedTimers.load(std::memory_order_acquire);
+            const Deadline nextDeadline = mStatus.nextDeadline.load(std::memory_order_acquire);
+            status.firedCallbacks = mStatus.firedCallbacks.load(std::memory_order_acquire);
+            status.nextDeadline.reset();
+            if(status.queuedTimers != 0)
+            {
+                status.nextDeadline = toTimePoint(nextDeadline);
+            }
+        }
+        while((sequence & 1) != 0 || sequence != mStatus.sequence.load(std::memory_order_relaxed));
+        return status;
+    }
+
+    // Whether a handle refers to a timer that has not been removed (nor fired, for a one-shot timer);
+    // a dormant Manual timer is active. Lock-free, like a lazy cancel.
+    bool isTimerActive(TimerHandle handle) const
+    {
+        const Timer* const timer = findTimerUnlocked(handle);
+        return timer != nullptr && timer->state.load(std::memory_order_acquire) == static_cast<uint32_t>(handle);
+    }
+
+    Executor& executor()
+    {
+        return mExecutor;
+    }
+
+    Tracer& tracer()
+    {
+        return mTracer;
+    }
+
+private:
+    enum class State
+    {
+        Off,
+        Running,
+        Stopping
+    };
+
+    using Deadline = TimerQueues::Deadline;
+
+    // Index into the timer table. A handle is the slot index combined with the slot's generation,
+    // which is bumped every time the slot is released so that stale handles can be detected.
+    using Slot = TimerQueues::Slot;
+    static constexpr Slot kInvalidSlot = UINT32_MAX;
+    static constexpr int kSlotBits = 24;
+    static constexpr Slot kSlotMask = (Slot(1) << kSlotBits) - 1;
+    static constexpr size_t kMaxSlots = size_t(1) << kSlotBits;
+    static constexpr uint32_t kMaxGeneration = uint32_t(INT32_MAX) >> kSlotBits;
+    // Only kMaxGeneration handles fit a slot, so a stale handle would match a new timer once its slot
+    // has been reused that often. Released slots therefore queue up (oldest reused first) until more
+    // than kReuseDelay are free, which keeps a handle unique for roughly kHandleReuseWindow further adds
+    // (fewer only at a hard capacity, which reuses slots as soon as the table is full).
+    static constexpr size_t kReuseDelay = 1024;
+    static constexpr size_t kHandleReuseWindow = kMaxGeneration * kReuseDelay;
+    static_assert(kHandleReuseWindow >= 100000, "stale handles must not alias new timers within 100000 adds");
+    // Set in a slot's state (on top of its handle) when the timer has been lazily cancelled
+    static constexpr uint32_t kTombstoneBit = UINT32_C(0x80000000);
+    static constexpr uint32_t kNoCalendar = UINT32_MAX;
+    static constexpr uint32_t kNoExtras = UINT32_MAX;
+    // Drain deadline of a stop without a grace period
+    static constexpr Deadline kNoDrain = INT64_MIN;
+    // Sleeping deadlines of the scheduler thread (see wakeThread())
+    static constexpr Deadline kAwake = INT64_MIN;
+    static constexpr Deadline kNoWake = INT64_MAX;
+    // A change of the wall clock's offset from Clock beyond this is taken as a clock step (rather than slewing)
+    static constexpr std::chrono::milliseconds kClockStepTolerance{10};
+
+    // The timer table is allocated in chunks that never move, so that a lazy cancel can reach a
+    // slot without locking while the table grows. Chunk 0 holds the first 2^kFirstChunkBits slots
+    // and every further chunk doubles the capacity, so the chunk directory stays tiny.
+    static constexpr int kFirstChunkBits = 8;
+    static constexpr size_t kMaxChunks = kSlotBits - kFirstChunkBits + 1;
+
+    using ConditionVariable = typename std::conditional<std::is_same<Lock, std::mutex>::value, std::condition_variable, std::condition_variable_any>::type;
+
+    // The node pool takes at most this many nodes of a size from its upstream at a time
+    static constexpr size_t kPoolChunkNodes = 4096;
+
+    // Upstream of the node pool: serves allocations from blocks that reserve() takes from the
+    // scheduler's upstream in one piece, and passes the rest on. Memory carved out of a block goes
+    // back to the upstream only with the block, when the scheduler is destroyed.
+    class ReserveResource : public std::pmr::memory_resource
+    {
+    public:
+        explicit ReserveResource(std::pmr::memory_resource* upstream) :
+            mUpstream(upstream)
+        {
+        }
+
+        ~ReserveResource() override
+        {
+            while(mBlocks != nullptr)
+            {
+                Block* const block = mBlocks;
+                mBlocks = block->previous;
+                mUpstream->deallocate(block, block->size, alignof(std::max_align_t));
+            }
+        }
+
+        // Makes sure that the next bytes allocated come from a block
+        void reserve(size_t bytes)
+        {
+            if(mEnd - mCursor >= bytes)
+            {
+                return;
+            }
+            const size_t size = sizeof(Block) + bytes;
+            Block* const block = static_cast<Block*>(mUpstream->allocate(size, alignof(std::max_align_t)));
+            block->previous = mBlocks;
+            block->size = size;
+            mBlocks = block;
+            mCursor = reinterpret_cast<uintptr_t>(block + 1);
+            mEnd = reinterpret_cast<uintptr_t>(block) + size;
+        }
+
+    private:
+        struct alignas(std::max_align_t) Block
+        {
+            Block* previous;
+            size_t size;
+        };
+
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            const uintptr_t start = (mCursor + alignment - 1) & ~uintptr_t(alignment - 1);
+            if(start <= mEnd && mEnd - start >= bytes)
+            {
+                mCursor = start + bytes;
+                return reinterpret_cast<void*>(start);
+            }
+            return mUpstream->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+        {
+            const uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+            for(const Block* block = mBlocks; block != nullptr; block = block->previous)
+            {
+                if(address >= reinterpret_cast<uintptr_t>(block) && address < reinterpret_cast<uintptr_t>(block) + block->size)
+                {
+                    return;
+                }
+            }
+            mUpstream->deallocate(pointer, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        std::pmr::memory_resource* mUpstream;
+        Block* mBlocks{nullptr};
+        uintptr_t mCursor{0};
+        uintptr_t mEnd{0};
+    };
+
+    // Hot part of a timer, which expiry and re-arming touch: 32 bytes (with a 64-bit Duration), so
+    // that two share a cache line. The callback is kept in a table of its own, indexed by the same
+    // slot; the fields that only some timers use are in a side table (see TimerExtras).
+    struct Timer
+    {
+        // The timer's handle, with kTombstoneBit set once lazily cancelled; 0 when the slot is free
+        std::atomic<uint32_t> state{0};
+        uint32_t generation{0};
+        Duration period{};
+        TimerGroup group{0};
+        // Index of the timer's record in mExtras, or kNoExtras; doubles as the free list link while the slot is free
+        uint32_t extras{kNoExtras};
+        TimerMode mode{TimerMode::Periodic};
+        TimerPriority priority{TimerPriority::Normal};
+        JitterMode jitter{JitterMode::None};
+        // Set while a Manual timer waits to be rescheduled; it is out of the queue (atomic for lazy cancellation)
+        std::atomic<bool> dormant{false};
+        // Set while a backoff timer's callback runs; it is out of the queue until re-armed
+        bool rearmPending{false};
+        // Set while the callback runs outside the lock; releasing the slot is deferred until it returns
+        bool firing{false};
+        bool releaseDeferred{false};
+    };
+
+    static_assert(sizeof(Duration) != 8 || sizeof(Timer) == 32, "the hot timer record should stay at 32 bytes");
+
+    // Cold part of a timer, for those with jitter, backoff, a callback key, a calendar expression or
+    // a group; other timers have none
+    struct TimerExtras
+    {
+        // Interval the timer was last armed with (see JitterMode::Decorrelated)
+        Duration lastInterval{};
+        // Backoff timers: the current delay (before jitter), its cap and growth, and the attempts made
+        Duration backoffDelay{};
+        Duration backoffCap{};
+        uint64_t callbackKey{0};
+        float jitterFraction{0.0f};
+        float backoffMultiplier{2.0f};
+        uint32_t attempts{0};
+        uint32_t maxAttempts{0};
+        // Calendar timers: index of the timer's entry in mCalendars
+        uint32_t calendar{kNoCalendar};
+        // Intrusive links of the timer's group
+        Slot groupPrev{kInvalidSlot};
+        Slot groupNext{kInvalidSlot};
+    };
+
+    struct CalendarEntry
+    {
+        CronExpression expression;
+        // The wall-clock time the timer is queued for
+        TimerCalendar::WallTimePoint next;
+        Slot slot;
+    };
+
+    struct TimedOutTimer
+    {
+        TimerHandle handle;
+        Slot slot;
+        Deadline deadline;
+        TimerPriority priority;
+        bool succeeded{false};
+        int64_t latenessNanoseconds{0};
+    };
+
+    // Whether the executor dispatches by priority class (see PriorityLaneExecutor)
+    static constexpr bool kExecutorTakesPriority = std::is_invocable<Executor&, Callback&, TimerHandle, TimerPriority>::value;
+    // Whether the executor passes on the callbacks' results (see InlineCallbackExecutor)
+    static constexpr bool kCallbacksReportResult = std::is_same<typename std::conditional<kExecutorTakesPriority,
+                                                                                          std::invoke_result<Executor&, Callback&, TimerHandle, TimerPriority>,
+                                                                                          std::invoke_result<Executor&, Callback&, TimerHandle>>::type::type, bool>::value;
+
+    struct Group
+    {
+        Slot head{kInvalidSlot};
+        GroupStatistics statistics;
+    };
+
+    using GroupMap = std::pmr::unordered_map<TimerGroup, Group>;
+
+    // Uniform in [0, 1)
+    double nextRandom()
+    {
+        uint64_t value = (mRandomState += UINT64_C(0x9e3779b97f4a7c15));
+        value = (value ^ (value >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        value = (value ^ (value >> 27)) * UINT64_C(0x94d049bb133111eb);
+        value ^= value >> 31;
+        return static_cast<double>(value >> 11) * 0x1.0p-53;
+    }
+
+    // Interval until the timer's next deadline: its period (or backoff delay), jittered as configured
+    Duration nextInterval(Timer& timer, Duration base)
+    {
+        if(timer.jitter == JitterMode::None)
+        {
+            return base;
+        }
+
+        TimerExtras& extras = extrasOf(timer);
+        const double period = static_cast<double>(base.count());
+        double interval;
+        if(timer.jitter == JitterMode::Uniform)
+        {
+            interval = period * (1.0 + extras.jitterFraction * (2.0 * nextRandom() - 1.0));
+        }
+        else
+        {
+            const double upper = std::min(period * (1.0 + extras.jitterFraction), 3.0 * static_cast<double>(extras.lastInterval.count()));
+            interval = period + nextRandom() * std::max(0.0, upper - period);
+        }
+        extras.lastInterval = Duration(static_cast<typename Duration::rep>(std::max(0.0, interval)));
+        return extras.lastInterval;
+    }
+
+    inline decltype(auto) execute(Callback& callback, TimerHandle handle, TimerPriority priority)
+    {
+        if constexpr(kExecutorTakesPriority)
+        {
+            return mExecutor(callback, handle, priority);
+        }
+        else
+        {
+            return mExecutor(callback, handle);
+        }
+    }
+
+    // Orders the timers due in this pass by priority class, keeping deadline order within a class
+    void sortByPriority()
+    {
+        if(mTimedOutTimers.size() < 2)
+        {
+            return;
+        }
+        std::array<size_t, TimerTypes::kPriorityClasses + 1> offsets = {};
+        for(const auto& timedOutTimer : mTimedOutTimers)
+        {
+            ++offsets[static_cast<size_t>(timedOutTimer.priority) + 1];
+        }
+        if(std::count(offsets.begin(), offsets.end(), size_t(0)) == TimerTypes::kPriorityClasses)
+        {
+            return; // a single class
+        }
+        for(size_t priority = 1; priority < offsets.size(); ++priority)
+        {
+            offsets[priority] += offsets[priority - 1];
+        }
+        mSortedTimers.resize(mTimedOutTimers.size());
+        for(const auto& timedOutTimer : mTimedOutTimers)
+        {
+            mSortedTimers[offsets[static_cast<size_t>(timedOutTimer.priority)]++] = timedOutTimer;
+        }
+        mTimedOutTimers.swap(mSortedTimers);
+    }
+
+    // Wakes the scheduler thread if it sleeps past deadline (a time of Clock); by default, if it sleeps
+    // at all. Called after unlocking, so that a woken thread does not block on the mutex: the thread
+    // publishes its sleeping deadline before it unlocks to sleep, so a later change of the queue sees it
+    // (and an earlier one was seen by the thread). A thread that is awake re-reads the queue before
+    // sleeping again, so most changes made while it processes timers cost no system call.
+    // A scheduler without locking has no thread to wake.
+    inline void wakeThread(Deadline deadline = kAwake)
+    {
+        if constexpr(!std::is_same<Lock, NullLock>::value)
+        {
+            if(deadline < mSleepDeadline.load(std::memory_order_seq_cst))
+            {
+                mWakeSequence.fetch_add(1, std::memory_order_seq_cst);
+#if defined(BASIC_TIMER_SCHEDULER_FUTEX)
+                ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mWakeSequence), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+                mCondition.notify_one();
+#endif
+            }
+        }
+    }
+
+    // Sleeps until woken (see wakeThread()) or until timeout, if any; the mutex is unlocked meanwhile
+    void sleepUntil(std::unique_lock<Lock>& lock, std::optional<TimePoint> timeout)
+    {
+        mSleepDeadline.store(timeout ? toDeadline(*timeout) : kNoWake, std::memory_order_seq_cst);
+#if defined(BASIC_TIMER_SCHEDULER_FUTEX)
+        const uint32_t sequence = mWakeSequence.load(std::memory_order_seq_cst);
+        lock.unlock();
+        // A wake between unlocking and waiting has changed the sequence, so the wait returns at once
+        if(!timeout)
+        {
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mWakeSequence), FUTEX_WAIT_PRIVATE, sequence, nullptr, nullptr, 0);
+        }
+        else
+        {
+            const std::chrono::nanoseconds remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(*timeout - Clock::now());
+            if(remaining.count() > 0)
+            {
+                const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+                timespec relativeTimeout;
+                relativeTimeout.tv_sec = static_cast<time_t>(seconds.count());
+                relativeTimeout.tv_nsec = static_cast<long>((remaining - seconds).count());
+                ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mWakeSequence), FUTEX_WAIT_PRIVATE, sequence, &relativeTimeout, nullptr, 0);
+            }
+        }
+        lock.lock();
+#else
+        if(!timeout)
+        {
+            mCondition.wait(lock);
+        }
+        else
+        {
+            mCondition.wait_until(lock, *timeout);
+        }
+#endif
+        mSleepDeadline.store(kAwake, std::memory_order_relaxed);
+    }
+
+    // Publishes the state, queue size, next deadline and fired callbacks for status(); must be called
+    // with the mutex locked (the only writer) after every change of them
+    void publishStatus()
+    {
+        const bool running = (mState == State::Running);
+        const size_t queuedTimers = mQueue.size();
+        const Deadline nextDeadline = (queuedTimers != 0) ? toDeadline(clockTime(mQueue.topDeadline())) : 0;
+
+        const uint32_t sequence = mStatus.sequence.load(std::memory_order_relaxed);
+        mStatus.sequence.store(sequence + 1, std::memory_order_relaxed);
+        // Release stores: a reader that sees any of the new values also sees the odd sequence
+        mStatus.running.store(running, std::memory_order_release);
+        mStatus.paused.store(mPaused, std::memory_order_release);
+        mStatus.queuedTimers.store(queuedTimers, std::memory_order_release);
+        mStatus.nextDeadline.store(nextDeadline, std::memory_order_release);
+        mStatus.firedCallbacks.store(mFiredCallbacks, std::memory_order_release);
+        mStatus.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    static inline Deadline toDeadline(TimePoint timePoint)
+    {
+        return static_cast<Deadline>(timePoint.time_since_epoch().count());
+    }
+
+    static inline TimePoint toTimePoint(Deadline deadline)
+    {
+        return TimePoint(Duration(deadline));
+    }
+
+    // The queue's time base at a time of Clock: Clock's time minus the time spent paused, standing
+    // still while paused. Must be called with the mutex locked, as must clockTime().
+    inline TimePoint queueTime(TimePoint now) const
+    {
+        return (mPaused ? mPausedAt : now) - mTimeShift;
+    }
+
+    // The time of Clock at which a queue deadline falls due (if not paused before)
+    inline TimePoint clockTime(Deadline deadline) const
+    {
+        return toTimePoint(deadline) + mTimeShift;
+    }
+
+    static inline size_t chunkSizeOf(size_t chunk)
+    {
+        return size_t(1) << (chunk == 0 ? kFirstChunkBits : kFirstChunkBits + chunk - 1);
+    }
+
+    static inline Slot chunkStartOf(int chunk)
+    {
+        return (chunk == 0) ? 0 : (Slot(1) << (kFirstChunkBits + chunk - 1));
+    }
+
+    // Returns the timer of a slot, which must lie within the allocated chunks
+    inline Timer* slotAddress(Slot slot) const
+    {
+        const int width = TimerQueues::Detail::bitWidth(slot >> kFirstChunkBits);
+        return mTimerChunks[width].load(std::memory_order_acquire) + (slot - chunkStartOf(width));
+    }
+
+    // Must be called with the mutex locked (or from the scheduler thread)
+    inline Timer& timerAt(Slot slot)
+    {
+        return *slotAddress(slot);
+    }
+
+    // The callback of a slot; may also be called while the slot is firing
+    inline Callback& callbackAt(Slot slot)
+    {
+        const int width = TimerQueues::Detail::bitWidth(slot >> kFirstChunkBits);
+        return mCallbackChunks[width][slot - chunkStartOf(width)];
+    }
+
+    // The rare fields of a timer that has them; must be called with the mutex locked
+    inline TimerExtras& extrasOf(const Timer& timer)
+    {
+        return mExtras[timer.extras];
+    }
+
+    // Gives a timer a (default) record in the side table, unless it has one
+    TimerExtras& acquireExtras(Timer& timer)
+    {
+        if(timer.extras == kNoExtras)
+        {
+            if(!mFreeExtras.empty())
+            {
+                timer.extras = mFreeExtras.back();
+                mFreeExtras.pop_back();
+                mExtras[timer.extras] = TimerExtras();
+            }
+            else
+            {
+                timer.extras = static_cast<uint32_t>(mExtras.size());
+                mExtras.emplace_back();
+            }
+        }
+        return mExtras[timer.extras];
+    }
+
+    void releaseExtras(Timer& timer)
+    {
+        if(timer.extras != kNoExtras)
+        {
+            mFreeExtras.push_back(timer.extras);
+            timer.extras = kNoExtras;
+        }
+    }
+
+    void addTimerChunk()
+    {
+        const size_t chunkSize = chunkSizeOf(mChunkCount);
+        Timer* const timers = static_cast<Timer*>(mUpstream->allocate(chunkSize * sizeof(Timer), alignof(Timer)));
+        Callback* const callbacks = static_cast<Callback*>(mUpstream->allocate(chunkSize * sizeof(Callback), alignof(Callback)));
+        for(size_t i = 0; i < chunkSize; ++i)
+        {
+            new(&timers[i]) Timer();
+            new(&callbacks[i]) Callback();
+        }
+        mCallbackChunks[mChunkCount] = callbacks;
+        mTimerChunks[mChunkCount].store(timers, std::memory_order_release);
+        ++mChunkCount;
+        mSlotCapacity += chunkSize;
+    }
+
+    // Lock-free lookup for lazy cancellation; returns nullptr for handles outside the table
+    inline Timer* findTimerUnlocked(TimerHandle handle) const
+    {
+        if(handle <= 0)
+        {
+            return nullptr;
+        }
+        const Slot slot = static_cast<Slot>(handle) & kSlotMask;
+        const int width = TimerQueues::Detail::bitWidth(slot >> kFirstChunkBits);
+        if(mTimerChunks[width].load(std::memory_order_acquire) == nullptr)
+        {
+            return nullptr;
+        }
+        return slotAddress(slot);
+    }
+
+    // Returns the slot for a handle, or kInvalidSlot if the handle is not (or no longer) in use
+    inline Slot findSlot(TimerHandle handle)
+    {
+        const Slot slot = static_cast<Slot>(handle) & kSlotMask;
+        if(handle > 0 && slot < mSlotCount && timerAt(slot).state.load(std::memory_order_relaxed) == static_cast<uint32_t>(handle))
+        {
+            return slot;
+        }
+        return kInvalidSlot;
+    }
+
+    // Takes a slot from the free list (oldest released first, and only once more than kReuseDelay are
+    // free, so that generations wrap slowly) or grows the table
+    Slot allocateSlot()
+    {
+        Slot slot = kInvalidSlot;
+        if(mFreeSlotCount > kReuseDelay || (mFreeSlotCount > 0 && mSlotCount >= mSlotLimit))
+        {
+            slot = mFreeSlotsHead;
+            mFreeSlotsHead = timerAt(slot).extras;
+            if(mFreeSlotsHead == kInvalidSlot)
+            {
+                mFreeSlotsTail = kInvalidSlot;
+            }
+            --mFreeSlotCount;
+        }
+        else if(mSlotCount < mSlotLimit)
+        {
+            if(mSlotCount == mSlotCapacity)
+            {
+                addTimerChunk();
+            }
+            slot = static_cast<Slot>(mSlotCount++);
+        }
+        else
+        {
+            return kInvalidSlot; // table is full (or at its hard capacity)
+        }
+
+        Timer& timer = timerAt(slot);
+        timer.generation = (timer.generation % kMaxGeneration) + 1;
+        timer.state.store((timer.generation << kSlotBits) | slot, std::memory_order_release);
+        timer.extras = kNoExtras;
+        return slot;
+    }
+
+    // Marks a live timer as a tombstone; returns false if the handle is stale or already removed.
+    // A scheduler without locking is only used from its owner thread, so it needs no read-modify-write
+    // atomics here and in releaseSlot.
+    bool markTombstone(Timer& timer, uint32_t expected)
+    {
+        if constexpr(std::is_same<Lock, NullLock>::value)
+        {
+            if(timer.state.load(std::memory_order_relaxed) != expected)
+            {
+                return false;
+            }
+            timer.state.store(expected | kTombstoneBit, std::memory_order_relaxed);
+            mTombstoneCount.store(mTombstoneCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        else
+        {
+            if(!timer.state.compare_exchange_strong(expected, expected | kTombstoneBit, std::memory_order_seq_cst))
+            {
+                return false;
+            }
+            mTombstoneCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void releaseSlot(Slot slot)
+    {
+        Timer& timer = timerAt(slot);
+        if constexpr(std::is_same<Lock, NullLock>::value)
+        {
+            if(timer.state.load(std::memory_order_relaxed) & kTombstoneBit)
+            {
+                mTombstoneCount.store(mTombstoneCount.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            }
+            timer.state.store(0, std::memory_order_relaxed);
+        }
+        else if(timer.state.exchange(0, std::memory_order_acq_rel) & kTombstoneBit)
+        {
+            mTombstoneCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if(timer.extras != kNoExtras && extrasOf(timer).calendar != kNoCalendar)
+        {
+            removeCalendarEntry(timer);
+        }
+        if(timer.firing)
+        {
+            // The callback is running; checkForTimeouts finishes the release once it has returned
+            timer.releaseDeferred = true;
+            return;
+        }
+        timer.releaseDeferred = false;
+        timer.rearmPending = false;
+        timer.dormant.store(false, std::memory_order_relaxed);
+        callbackAt(slot) = Callback();
+        timer.group = 0;
+        releaseExtras(timer);
+        appendToFreeList(slot);
+    }
+
+    void removeCalendarEntry(Timer& timer)
+    {
+        const uint32_t index = extrasOf(timer).calendar;
+        if(index + 1 != mCalendars.size())
+        {
+            mCalendars[index] = std::move(mCalendars.back());
+            extrasOf(timerAt(mCalendars[index].slot)).calendar = index;
+        }
+        mCalendars.pop_back();
+        extrasOf(timer).calendar = kNoCalendar;
+    }
+
+    // Offset of the wall clock from the queue's time base (see queueTime()); a pause shifts it like a
+    // clock step, so calendar timers are re-keyed on resume
+    std::chrono::nanoseconds wallClockOffset() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(WallClock::now().time_since_epoch()) - std::chrono::duration_cast<std::chrono::nanoseconds>(queueTime(Clock::now()).time_since_epoch());
+    }
+
+    // Deadline of a wall-clock time, given the wall clock's offset (rounded up, so as not to fire early)
+    static Deadline calendarDeadline(TimerCalendar::WallTimePoint wallTime, std::chrono::nanoseconds offset)
+    {
+        return toDeadline(TimePoint(std::chrono::ceil<Duration>(std::chrono::duration_cast<std::chrono::nanoseconds>(wallTime.time_since_epoch()) - offset)));
+    }
+
+    // Re-keys the calendar timers if the wall clock has been stepped since the last check
+    void checkForClockStep()
+    {
+        const std::chrono::nanoseconds offset = wallClockOffset();
+        const std::chrono::nanoseconds change = offset - mWallClockOffset;
+        mWallClockOffset = offset;
+        if(change <= kClockStepTolerance && change >= -kClockStepTolerance)
+        {
+            return;
+        }
+
+        const TimerCalendar::WallTimePoint wallNow = WallClock::now();
+        for(CalendarEntry& entry : mCalendars)
+        {
+            if(entry.next > wallNow)
+            {
+                // Stepped back (or forward, but not past it): the next time may have changed
+                const std::optional<TimerCalendar::WallTimePoint> next = entry.expression.next(wallNow);
+                if(next)
+                {
+                    entry.next = *next;
+                }
+            }
+            mQueue.erase(entry.slot);
+            mQueue.push(calendarDeadline(entry.next, offset), entry.slot);
+        }
+    }
+
+    // Bounds a wait while calendar timers need clock step checks
+    TimePoint boundedTimeout(TimePoint timeout) const
+    {
+        if(!mCalendars.empty())
+        {
+            return std::min(timeout, Clock::now() + std::chrono::duration_cast<Duration>(kClockStepCheckInterval));
+        }
+        return timeout;
+    }
+
+    void appendToFreeList(Slot slot)
+    {
+        timerAt(slot).extras = kInvalidSlot;
+        if(mFreeSlotsTail != kInvalidSlot)
+        {
+            timerAt(mFreeSlotsTail).extras = slot;
+        }
+        else
+        {
+            mFreeSlotsHead = slot;
+        }
+        mFreeSlotsTail = slot;
+        ++mFreeSlotCount;
+    }
+
+    inline void removeFromQueue(Slot slot)
+    {
+        if(timerAt(slot).rearmPending || timerAt(slot).dormant.load(std::memory_order_relaxed))
+        {
+            return; // not queued
+        }
+        mQueue.erase(slot);
+    }
+
+    inline bool isTombstone(Slot slot)
+    {
+        return (timerAt(slot).state.load(std::memory_order_acquire) & kTombstoneBit) != 0;
+    }
+
+    // Removes a lazily cancelled timer for good
+    inline void dropTombstone(Slot slot)
+    {
+        removeFromQueue(slot);
+        unlinkFromGroup(slot, true);
+        releaseSlot(slot);
+    }
+
+    // Tombstones at the head would only cause a pointless wakeup
+    void dropTombstonesAtHead()
+    {
+        if(!mQueue.empty() && isTombstone(mQueue.top()))
+        {
+            do
+            {
+                dropTombstone(mQueue.top());
+            }
+            while(!mQueue.empty() && isTombstone(mQueue.top()));
+            publishStatus();
+        }
+    }
+
+    // Drops all tombstones once they make up more than the compaction threshold of the queue
+    void compactTombstones()
+    {
+        const size_t tombstoneCount = mTombstoneCount.load(std::memory_order_relaxed);
+        if(tombstoneCount == 0 || tombstoneCount <= mCompactionThreshold * mQueue.size())
+        {
+            return;
+        }
+
+        mTombstones.clear();
+        mQueue.forEach([this](Slot slot, Deadline)
+        {
+            if(isTombstone(slot))
+            {
+                mTombstones.push_back(slot);
+            }
+        });
+        for(const Slot slot : mTombstones)
+        {
+            dropTombstone(slot);
+        }
+    }
+
+    void linkIntoGroup(Slot slot)
+    {
+        Timer& timer = timerAt(slot);
+        if(timer.group != 0)
+        {
+            Group& group = mGroups[timer.group];
+            extrasOf(timer).groupNext = group.head;
+            if(group.head != kInvalidSlot)
+            {
+                extrasOf(timerAt(group.head)).groupPrev = slot;
+            }
+            group.head = slot;
+            ++group.statistics.activeTimers;
+            ++group.statistics.addedTimers;
+        }
+    }
+
+    void unlinkFromGroup(Slot slot, bool cancelled)
+    {
+        Timer& timer = timerAt(slot);
+        if(timer.group != 0)
+        {
+            const auto groupIter = mGroups.find(timer.group);
+            Group& group = groupIter->second;
+            TimerExtras& extras = extrasOf(timer);
+            if(extras.groupPrev != kInvalidSlot)
+            {
+                extrasOf(timerAt(extras.groupPrev)).groupNext = extras.groupNext;
+            }
+            else
+            {
+                group.head = extras.groupNext;
+            }
+            if(extras.groupNext != kInvalidSlot)
+            {
+                extrasOf(timerAt(extras.groupNext)).groupPrev = extras.groupPrev;
+            }
+            extras.groupPrev = kInvalidSlot;
+            extras.groupNext = kInvalidSlot;
+
+            if(cancelled)
+            {
+                ++group.statistics.cancelledTimers;
+            }
+            --group.statistics.activeTimers;
+        }
+    }
+
+    // Completes a stop once the timers due within the grace period have fired (or right away when
+    // paused); returns true if the scheduler has stopped. Must be called with the mutex locked.
+    bool finishStopIfDrained()
+    {
+        if(mState != State::Stopping)
+        {
+            return false;
+        }
+        if(mDrainDeadline != kNoDrain && !mPaused)
+        {
+            dropTombstonesAtHead();
+            if(!mQueue.empty() && mQueue.topDeadline() <= mDrainDeadline)
+            {
+                return false;
+            }
+        }
+
+        if(mStopKeepsTimers)
+        {
+            if(!mPaused)
+            {
+                mPaused = true;
+                mPausedAt = Clock::now();
+            }
+        }
+        else
+        {
+            releaseAllTimers();
+        }
+        mState = State::Off; // transition to Off state
+        publishStatus();
+        return true;
+    }
+
+    // Must be called with the mutex locked
+    void releaseAllTimers()
+    {
+        // Release every slot (rather than clearing the table) so that handles from before the reset stay stale;
+        // walk the table rather than the queue, which does not hold dormant timers
+        for(size_t slot = 0; slot < mSlotCount; ++slot)
+        {
+            if(timerAt(static_cast<Slot>(slot)).state.load(std::memory_order_relaxed) != 0)
+            {
+                releaseSlot(static_cast<Slot>(slot));
+            }
+        }
+        mQueue.clear();
+        mGroups.clear();
+        mPriorityStatistics = {};
+        mFiredCallbacks = 0;
+        mTombstoneCount = 0;
+        mPaused = false;
+        mTimeShift = Duration::zero();
+    }
+
+    void timerThreadLoop()
+    {
+        while(1)
+        {
+            // If either step indicates that loop should stop, break out
+            if(!checkForTimeouts() || !waitForNextTimeout())
+            {
+                break;
+            }
+        }
+    }
+
+    // Returns false if thread should be stopped
+    bool checkForTimeouts()
+    {
+        // check for timeouts
+        mTimedOutTimers.clear();
+        {
+            std::lock_guard<Lock> lock(mMutex);
+
+            // If should not be running, indicate to thread loop that it is time to stop
+            if(mState == State::Off || finishStopIfDrained())
+            {
+                return false;
+            }
+
+            if(mPaused)
+            {
+                return true;
+            }
+
+            if(!mCalendars.empty())
+            {
+                checkForClockStep();
+            }
+
+            const TimePoint now = queueTime(Clock::now()); // get time AFTER mutex has been locked
+            // While stopping, only the timers due within the grace period fire
+            const Deadline limit = (mState == State::Stopping) ? std::min(toDeadline(now), mDrainDeadline) : toDeadline(now);
+            mTombstones.clear();
+            mQueue.popExpired(limit, [this](Slot slot, Deadline deadline)
+            {
+                const uint32_t state = timerAt(slot).state.load(std::memory_order_acquire);
+                if(state & kTombstoneBit)
+                {
+                    mTombstones.push_back(slot);
+                }
+                else
+                {
+                    mTimedOutTimers.push_back(TimedOutTimer{static_cast<TimerHandle>(state), slot, toDeadline(clockTime(deadline)), timerAt(slot).priority});
+                }
+            });
+            sortByPriority();
+
+            // lazily cancelled timers that reached the head are dropped instead of fired
+            for(const Slot slot : mTombstones)
+            {
+                unlinkFromGroup(slot, true);
+                releaseSlot(slot);
+            }
+            compactTombstones();
+
+            // re-insert timed out timers
+            for(const auto& timedOutTimer : mTimedOutTimers)
+            {
+                Timer& timer = timerAt(timedOutTimer.slot);
+                timer.firing = true;
+
+                if(timer.group != 0)
+                {
+                    ++mGroups[timer.group].statistics.firedCallbacks;
+                }
+
+                if(timer.mode == TimerMode::OneShot)
+                {
+                    // one-shot timers are done; the slot is released once the callback has returned
+                    unlinkFromGroup(timedOutTimer.slot, false);
+                    releaseSlot(timedOutTimer.slot);
+                }
+                else if(timer.mode == TimerMode::Manual)
+                {
+                    // kept allocated, out of the queue, until rescheduled
+                    timer.dormant.store(true, std::memory_order_seq_cst);
+                }
+                else if(timer.mode == TimerMode::Backoff)
+                {
+                    // re-armed (or finished) once the callback has reported its result
+                    timer.rearmPending = true;
+                    ++extrasOf(timer).attempts;
+                }
+                else if(timer.mode == TimerMode::Calendar)
+                {
+                    // the time after the one just due, or after now if late (skipping missed times)
+                    CalendarEntry& entry = mCalendars[extrasOf(timer).calendar];
+                    const std::optional<TimerCalendar::WallTimePoint> next = entry.expression.next(std::max(entry.next, WallClock::now()));
+                    if(next)
+                    {
+                        entry.next = *next;
+                        mQueue.push(calendarDeadline(*next, wallClockOffset()), timedOutTimer.slot);
+                    }
+                    else
+                    {
+                        unlinkFromGroup(timedOutTimer.slot, false);
+                        releaseSlot(timedOutTimer.slot);
+                    }
+                }
+                else
+                {
+                    mQueue.push(toDeadline(now + nextInterval(timer, timer.period)), timedOutTimer.slot);
+                }
+            }
+            mDispatching = !mTimedOutTimers.empty();
+            publishStatus();
+        }
+
+        if(mTimedOutTimers.size() > 0)
+        {
+            // call the callbacks in place; the slots cannot be reused while they are firing
+            for(auto& timedOutTimer : mTimedOutTimers)
+            {
+                mTracer.record(TimerTypes::TraceEvent::Fire, timedOutTimer.handle);
+                timedOutTimer.latenessNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - toTimePoint(timedOutTimer.deadline)).count();
+                if constexpr(kCallbacksReportResult)
+                {
+                    timedOutTimer.succeeded = execute(callbackAt(timedOutTimer.slot), timedOutTimer.handle, timedOutTimer.priority);
+                }
+                else
+                {
+                    execute(callbackAt(timedOutTimer.slot), timedOutTimer.handle, timedOutTimer.priority);
+                }
+            }
+
+            // finish releasing timers that were removed from within (or during) their callback,
+            // and re-arm backoff timers that are to retry
+            std::lock_guard<Lock> lock(mMutex);
+            mDispatching = false;
+            const TimePoint now = queueTime(Clock::now());
+            for(const auto& timedOutTimer : mTimedOutTimers)
+            {
+                PriorityStatistics& statistics = mPriorityStatistics[static_cast<size_t>(timedOutTimer.priority)];
+                ++statistics.firedCallbacks;
+                statistics.totalLatenessNanoseconds += timedOutTimer.latenessNanoseconds;
+                statistics.maxLatenessNanoseconds = std::max(statistics.maxLatenessNanoseconds, timedOutTimer.latenessNanoseconds);
+
+                Timer& timer = timerAt(timedOutTimer.slot);
+                timer.firing = false;
+                if(timer.releaseDeferred)
+                {
+                    releaseSlot(timedOutTimer.slot);
+                }
+                else if(timer.dormant.load(std::memory_order_relaxed) && (timer.state.load(std::memory_order_seq_cst) & kTombstoneBit))
+                {
+                    // lazily cancelled just as it went dormant
+                    unlinkFromGroup(timedOutTimer.slot, true);
+                    releaseSlot(timedOutTimer.slot);
+                }
+                else if(timer.rearmPending)
+                {
+                    timer.rearmPending = false;
+                    if(timer.state.load(std::memory_order_acquire) & kTombstoneBit)
+                    {
+                        unlinkFromGroup(timedOutTimer.slot, true);
+                        releaseSlot(timedOutTimer.slot);
+                    }
+                    else if(timedOutTimer.succeeded || (extrasOf(timer).maxAttempts != 0 && extrasOf(timer).attempts >= extrasOf(timer).maxAttempts) || (mState != State::Running && !mStopKeepsTimers))
+                    {
+                        unlinkFromGroup(timedOutTimer.slot, false);
+                        releaseSlot(timedOutTimer.slot);
+                    }
+                    else
+                    {
+                        TimerExtras& extras = extrasOf(timer);
+                        const double delay = static_cast<double>(extras.backoffDelay.count()) * extras.backoffMultiplier;
+                        extras.backoffDelay = (delay >= static_cast<double>(extras.backoffCap.count())) ? extras.backoffCap : Duration(static_cast<typename Duration::rep>(delay));
+                        mQueue.push(toDeadline(now + nextInterval(timer, extras.backoffDelay)), timedOutTimer.slot);
+                    }
+                }
+            }
+            mFiredCallbacks += mTimedOutTimers.size();
+            publishStatus();
+        }
+
+        return true;
+    }
+
+    // Returns false if thread should be stopped
+    bool waitForNextTimeout()
+    {
+        std::unique_lock<Lock> lock(mMutex);
+
+        // If should not be running, indicate to thread loop that it is time to stop
+        if(mState == State::Off || finishStopIfDrained())
+        {
+            return false;
+        }
+
+        dropTombstonesAtHead();
+
+        if(!mQueue.empty() && !mPaused)
+        {
+            // wait for next timeout to happen
+            const TimePoint timeout = boundedTimeout(clockTime(mQueue.topDeadline()));
+            sleepUntil(lock, timeout);
+            mTracer.record(TimerTypes::TraceEvent::Wake, 0, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - Clock::now()).count());
+        }
+        else
+        {
+            // If there are no timers (or paused), wait indefinitely (will wake up and reevaluate if a timer is scheduled).
+            sleepUntil(lock, std::nullopt);
+            mTracer.record(TimerTypes::TraceEvent::Wake, 0);
+        }
+
+        return true;
+    }
+
+    // Timer data:
+    std::pmr::memory_resource* mUpstream;
+    // Pool backing the container nodes, and the block it takes them from after reserve()
+    ReserveResource mReserve;
+    std::pmr::unsynchronized_pool_resource mNodePool;
+    // Queue of deadline -> timer slot
+    Queue mQueue;
+    // Timer table, indexed by slot; slots are recycled through an intrusive free list
+    std::atomic<Timer*> mTimerChunks[kMaxChunks] = {};
+    // Callback table, chunked like the timer table
+    Callback* mCallbackChunks[kMaxChunks] = {};
+    size_t mChunkCount{0};
+    size_t mSlotCapacity{0};
+    size_t mSlotCount{0};
+    size_t mSlotLimit{std::min(kMaxSlots, Queue::kCapacity)};
+    Slot mFreeSlotsHead{kInvalidSlot};
+    Slot mFreeSlotsTail{kInvalidSlot};
+    size_t mFreeSlotCount{0};
+    // Side table of the timers' rare fields, with its free records
+    std::pmr::vector<TimerExtras> mExtras;
+    std::pmr::vector<uint32_t> mFreeExtras;
+    // Timer groups, each heading an intrusive list of its timers
+    GroupMap mGroups;
+    // Calendar timers, and the wall clock's offset from Clock when last checked
+    std::pmr::vector<CalendarEntry> mCalendars;
+    std::chrono::nanoseconds mWallClockOffset{0};
+
+    // State of the jitter PRNG (splitmix64)
+    uint64_t mRandomState{0};
+
+    // Lazy cancellation
+    std::atomic<CancelMode> mCancelMode{CancelMode::Eager};
+    std::atomic<size_t> mTombstoneCount{0};
+    float mCompactionThreshold{0.25f};
+
+    // Fired callbacks and lateness per priority class, and fired callbacks in total
+    std::array<PriorityStatistics, TimerTypes::kPriorityClasses> mPriorityStatistics{};
+    uint64_t mFiredCallbacks{0};
+
+    // Pausing: the queue's deadlines are on Clock's time minus mTimeShift, the time spent paused, so
+    // that resume() moves them all at once; while paused, the queue's time stands still at mPausedAt
+    bool mPaused{false};
+    TimePoint mPausedAt{};
+    Duration mTimeShift{Duration::zero()};
+
+    // Stopping: the timers due up to mDrainDeadline (queue time) still fire; kept or removed afterwards
+    Deadline mDrainDeadline{kNoDrain};
+    bool mStopKeepsTimers{false};
+    // Set while the callbacks of a scheduler without a thread run, so that a stop() from one is deferred
+    bool mDispatching{false};
+
+    // Status published for observers (see status() and publishStatus()); a seqlock on a cache line
+    // of its own, so that polling it does not disturb the fields of the hot path
+    struct alignas(64) PublishedStatus
+    {
+        // Odd while a publish is in progress
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<bool> running{false};
+        std::atomic<bool> paused{false};
+        std::atomic<size_t> queuedTimers{0};
+        std::atomic<Deadline> nextDeadline{0};
+        std::atomic<uint64_t> firedCallbacks{0};
+    };
+    PublishedStatus mStatus;
+
+    // Scratch storage of the scheduler thread, kept to avoid allocating on every timeout
+    std::vector<TimedOutTimer> mTimedOutTimers;
+    std::vector<TimedOutTimer> mSortedTimers;
+    std::vector<Slot> mTombstones;
+
+    Executor mExecutor;
+
+    Tracer mTracer;
+
+    // Wake-up of the scheduler thread (see wakeThread()): the deadline it sleeps until (kAwake while it
+    // is awake, kNoWake while it sleeps without one), and the word it sleeps on, bumped by every wake
+    std::atomic<Deadline> mSleepDeadline{kAwake};
+    std::atomic<uint32_t> mWakeSequence{0};
+#if !defined(BASIC_TIMER_SCHEDULER_FUTEX)
+    ConditionVariable mCondition;
+#endif
+
+    Lock mMutex;
+
+    std::thread mThread;
+
+    State mState{State::Off};
+};
@@ -0,0 +1,365 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "BasicTimerScheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Scheduler owned by a single worker thread (thread-per-core servers), driven from that thread's
+// own loop with poll() and nextTimeout(). On the owner thread, adding and removing timers goes
+// straight to an unsynchronized scheduler (a NullLock BasicTimerScheduler, by default on a timing
+// wheel), which takes no lock and uses plain atomic loads and stores only. Other threads forward their adds and removes through a single-producer/single-consumer
+// inbox per thread, which the owner drains in poll().
+//
+// A timer added from another thread gets a forwarded handle (a negative value) that can be used
+// to remove it from any thread; its callback is invoked with the local handle.
+template<typename Queue = TimerQueues::TimerWheelQueue<>>
+class LocalTimerScheduler
+{
+public:
+    using TimerHandle = TimerTypes::TimerHandle;
+    using TimerCallback = std::function<void(TimerHandle handle)>;
+    using TimerOptions = TimerTypes::TimerOptions;
+    using Scheduler = BasicTimerScheduler<std::chrono::steady_clock, Queue, NullLock, TimerCallback, InlineCallbackExecutor>;
+
+    // Must be constructed on the owner thread. inboxCapacity is the number of commands each
+    // foreign thread can have in flight before falling back to a locked overflow list.
+    explicit LocalTimerScheduler(size_t inboxCapacity = 1024, std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) :
+        mScheduler(upstream),
+        mOwner(std::this_thread::get_id()),
+        mId(nextSchedulerId()),
+        mInboxCapacity(roundUpToPowerOfTwo(inboxCapacity))
+    {
+        mScheduler.start();
+    }
+
+    LocalTimerScheduler(const LocalTimerScheduler&) = delete;
+    LocalTimerScheduler& operator=(const LocalTimerScheduler &) = delete;
+    LocalTimerScheduler(LocalTimerScheduler &&) = delete;
+    LocalTimerScheduler & operator=(LocalTimerScheduler &&) = delete;
+
+    // Called by foreign threads after forwarding a command, so that the owner's loop can wake up
+    // (e.g. by writing to an eventfd). Must be set before other threads use the scheduler.
+    void setWakeup(std::function<void()> wakeup)
+    {
+        mWakeup = std::move(wakeup);
+    }
+
+    TimerHandle addTimer(const std::chrono::milliseconds& period, TimerCallback callback, const TimerOptions& options = TimerOptions())
+    {
+        if(onOwnerThread())
+        {
+            return mScheduler.addTimer(period, std::move(callback), options);
+        }
+
+        const TimerHandle ticket = -static_cast<TimerHandle>(mNextTicket.fetch_add(1, std::memory_order_relaxed) % INT32_MAX + 1);
+        forward(Command{Command::Type::Add, ticket, period, options, std::move(callback)});
+        return ticket;
+    }
+
+    void removeTimer(TimerHandle handle)
+    {
+        if(onOwnerThread())
+        {
+            removeOnOwner(handle);
+            return;
+        }
+
+        forward(Command{Command::Type::Remove, handle, std::chrono::milliseconds(0), TimerOptions(), TimerCallback()});
+    }
+
+    // Owner thread: apply forwarded commands and fire the due timers; returns the number of
+    // callbacks invoked.
+    size_t poll()
+    {
+        drainInboxes();
+        return mScheduler.processTimeouts();
+    }
+
+    // Owner thread: when poll() needs to be called next (forwarded commands aside).
+    std::optional<std::chrono::steady_clock::time_point> nextTimeout()
+    {
+        return mScheduler.nextTimeout();
+    }
+
+    // Owner thread: the underlying scheduler, e.g. for groups or reserve().
+    Scheduler& scheduler()
+    {
+        return mScheduler;
+    }
+
+private:
+    struct Command
+    {
+        enum class Type
+        {
+            Add,
+            Remove
+        };
+
+        Type type{Type::Add};
+        TimerHandle handle{0}; // forwarded handle for Add, any handle for Remove
+        std::chrono::milliseconds period{0};
+        TimerOptions options;
+        TimerCallback callback;
+    };
+
+    // Single-producer/single-consumer ring of commands
+    class Inbox
+    {
+    public:
+        explicit Inbox(size_t capacity) :
+            mCommands(capacity),
+            mMask(capacity - 1)
+        {
+        }
+
+        // Producer side; returns false if the ring is full
+        bool push(Command& command)
+        {
+            const size_t tail = mTail.load(std::memory_order_relaxed);
+            if(tail - mHeadCache == mCommands.size())
+            {
+                mHeadCache = mHead.load(std::memory_order_acquire);
+                if(tail - mHeadCache == mCommands.size())
+                {
+                    return false;
+                }
+            }
+            mCommands[tail & mMask] = std::move(command);
+            mTail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side; takes the oldest command, if any
+        bool pop(Command& command)
+        {
+            const size_t head = mHead.load(std::memory_order_relaxed);
+            if(head == mTail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            command = std::move(mCommands[head & mMask]);
+            mCommands[head & mMask].callback = nullptr;
+            mHead.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::vector<Command> mCommands;
+        const size_t mMask;
+        alignas(64) std::atomic<size_t> mHead{0};
+        alignas(64) std::atomic<size_t> mTail{0};
+        size_t mHeadCache{0}; // producer's last seen head
+    };
+
+    static constexpr size_t kMaxInboxes = 256;
+
+    static uint64_t nextSchedulerId()
+    {
+        static std::atomic<uint64_t> nextId{1};
+        return nextId.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = 1;
+        while(result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    bool onOwnerThread() const
+    {
+        return std::this_thread::get_id() == mOwner;
+    }
+
+    // The calling thread's inbox, registered on first use; nullptr once kMaxInboxes are in use
+    Inbox* inboxOfThisThread()
+    {
+        // Keyed by scheduler id rather than address, so that a new scheduler at a reused address
+        // does not inherit a stale inbox
+        thread_local std::vector<std::pair<uint64_t, Inbox*>> inboxes;
+        for(const auto& entry : inboxes)
+        {
+            if(entry.first == mId)
+            {
+                return entry.second;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mForeignMutex);
+        const size_t count = mInboxCount.load(std::memory_order_relaxed);
+        if(count == kMaxInboxes)
+        {
+            return nullptr;
+        }
+        mInboxStorage.emplace_back(new Inbox(mInboxCapacity));
+        Inbox* const inbox = mInboxStorage.back().get();
+        mInboxes[count] = inbox;
+        mInboxCount.store(count + 1, std::memory_order_release);
+        inboxes.emplace_back(mId, inbox);
+        return inbox;
+    }
+
+    void forward(Command command)
+    {
+        Inbox* const inbox = inboxOfThisThread();
+        if(inbox == nullptr || !inbox->push(command))
+        {
+            std::lock_guard<std::mutex> lock(mForeignMutex);
+            mOverflow.push_back(std::move(command));
+            mOverflowPending.store(true, std::memory_order_release);
+        }
+        if(mWakeup)
+        {
+            mWakeup();
+        }
+    }
+
+    void drainInboxes()
+    {
+        const size_t count = mInboxCount.load(std::memory_order_acquire);
+        Command command;
+        for(size_t i = 0; i < count; ++i)
+        {
+            while(mInboxes[i]->pop(command))
+            {
+                apply(command);
+            }
+        }
+
+        if(mOverflowPending.load(std::memory_order_acquire))
+        {
+            std::vector<Command> overflow;
+            {
+                std::lock_guard<std::mutex> lock(mForeignMutex);
+                overflow.swap(mOverflow);
+                mOverflowPending.store(false, std::memory_order_relaxed);
+            }
+            for(auto& overflowCommand : overflow)
+            {
+                apply(overflowCommand);
+            }
+        }
+    }
+
+    void apply(Command& command)
+    {
+        if(command.type == Command::Type::Remove)
+        {
+            removeOnOwner(command.handle);
+            return;
+        }
+
+        ++mAppliedAdds;
+        const TimerHandle ticket = command.handle;
+
+        // Forget the forwarded handle once the scheduler releases the slot and with it the callback,
+        // whichever way the timer ends (a one-shot that fired, a backoff timer that succeeded or gave
+        // up, or a removal by its local handle)
+        auto eraser = std::make_shared<ForwardedHandleEraser>(ForwardedHandleEraser{this, ticket});
+        TimerCallback callback = [eraser = std::move(eraser), callback = std::move(command.callback)](TimerHandle handle)
+        {
+            callback(handle);
+        };
+        const TimerHandle handle = mScheduler.addTimer(command.period, std::move(callback), command.options);
+        if(handle != 0)
+        {
+            mForwardedHandles[ticket] = handle;
+        }
+    }
+
+    void removeOnOwner(TimerHandle handle)
+    {
+        if(handle >= 0)
+        {
+            mScheduler.removeTimer(handle);
+            return;
+        }
+
+        auto iter = mForwardedHandles.find(handle);
+        if(iter == mForwardedHandles.end() && !mDraining && mAppliedAdds != mNextTicket.load(std::memory_order_relaxed))
+        {
+            // The add may still be in flight (possibly in another thread's inbox); it was forwarded
+            // before the handle became known to the remover, so it is visible to a drain now. Once
+            // every ticket handed out has been applied, a missing handle is one whose timer is done.
+            mDraining = true;
+            drainInboxes();
+            mDraining = false;
+            iter = mForwardedHandles.find(handle);
+        }
+        if(iter != mForwardedHandles.end())
+        {
+            // Erase first: releasing the slot erases the entry as well
+            const TimerHandle local = iter->second;
+            mForwardedHandles.erase(iter);
+            mScheduler.removeTimer(local);
+        }
+    }
+
+    struct ForwardedHandleEraser
+    {
+        LocalTimerScheduler* scheduler;
+        TimerHandle ticket;
+
+        ~ForwardedHandleEraser()
+        {
+            scheduler->mForwardedHandles.erase(ticket);
+        }
+    };
+
+    // Owner thread state (no synchronization). The forwarded handles outlive the scheduler, whose
+    // callbacks erase them on destruction.
+    std::unordered_map<TimerHandle, TimerHandle> mForwardedHandles;
+    Scheduler mScheduler;
+    const std::thread::id mOwner;
+    const uint64_t mId;
+    uint32_t mAppliedAdds{0};
+    bool mDraining{false};
+
+    // Foreign thread state
+    const size_t mInboxCapacity;
+    std::function<void()> mWakeup;
+    std::atomic<uint32_t> mNextTicket{0};
+    Inbox* mInboxes[kMaxInboxes] = {};
+    std::atomic<size_t> mInboxCount{0};
+    std::mutex mForeignMutex; // guards inbox registration and the overflow list
+    std::vector<std::unique_ptr<Inbox>> mInboxStorage;
+    std::vector<Command> mOverflow;
+    std::atomic<bool> mOverflowPending{false};
+};
@@ -0,0 +1,201 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "BasicTimerScheduler.hpp"
+#include "TimerNuma.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Scheduler for multi-socket machines, with one shard per NUMA node (see TimerNuma.hpp). Each shard
+// is a BasicTimerScheduler whose thread runs on the node's CPUs, whose timer storage and pools are
+// bound to the node's memory, and whose executor is created on the node (so the threads it starts
+// and the memory it first touches are local too). addTimer places a timer on the caller's node, so
+// the timers a thread adds are stored, expired and dispatched without remote-memory accesses;
+// addTimerOnNode places it explicitly.
+//
+// Handles carry their shard (node) in the upper 32 bits, so they are wider than TimerHandle;
+// callbacks are invoked with the same handle addTimer returned.
+template<typename Queue = TimerQueues::MultimapQueue, typename Executor = InlineCallbackExecutor>
+class NumaTimerScheduler
+{
+public:
+    using TimerHandle = int64_t;
+    using TimerCallback = std::function<void(TimerHandle handle)>;
+    using TimerOptions = TimerTypes::TimerOptions;
+    using StopOptions = TimerTypes::StopOptions;
+    using Scheduler = BasicTimerScheduler<std::chrono::steady_clock, Queue, std::mutex, std::function<void(TimerTypes::TimerHandle handle)>, Executor>;
+    // Creates the executor of a node's shard; called on a thread bound to the node
+    using ExecutorFactory = std::function<Executor(unsigned node)>;
+
+    explicit NumaTimerScheduler(ExecutorFactory executorForNode = [](unsigned) { return Executor(); })
+    {
+        const unsigned nodeCount = TimerNuma::nodeCount();
+        mShards.reserve(nodeCount);
+        TimerNuma::ThreadAffinityGuard affinity;
+        for(unsigned node = 0; node < nodeCount; ++node)
+        {
+            TimerNuma::bindThreadToNode(node);
+            Shard shard;
+            shard.memory = std::make_unique<TimerNuma::NodeMemoryResource>(node);
+            void* const storage = shard.memory->allocate(sizeof(Scheduler), alignof(Scheduler));
+            shard.scheduler = new(storage) Scheduler(shard.memory.get(), executorForNode(node));
+            mShards.push_back(std::move(shard));
+        }
+    }
+
+    NumaTimerScheduler(const NumaTimerScheduler&) = delete;
+    NumaTimerScheduler& operator=(const NumaTimerScheduler &) = delete;
+    NumaTimerScheduler(NumaTimerScheduler &&) = delete;
+    NumaTimerScheduler & operator=(NumaTimerScheduler &&) = delete;
+
+    ~NumaTimerScheduler()
+    {
+        for(Shard& shard : mShards)
+        {
+            shard.scheduler->~Scheduler();
+            shard.memory->deallocate(shard.scheduler, sizeof(Scheduler), alignof(Scheduler));
+        }
+    }
+
+    // Reserve timer storage on every node; see BasicTimerScheduler::reserve.
+    void reserve(size_t anticipatedNumberOfTimersPerNode, bool hardCapacity = false)
+    {
+        TimerNuma::ThreadAffinityGuard affinity;
+        for(unsigned node = 0; node < mShards.size(); ++node)
+        {
+            TimerNuma::bindThreadToNode(node); // without mbind, the pages reserve() touches are placed by first touch
+            mShards[node].scheduler->reserve(anticipatedNumberOfTimersPerNode, hardCapacity);
+        }
+    }
+
+    // Start the shards' threads, each bound to its node (a thread inherits the affinity of the
+    // thread starting it).
+    void run()
+    {
+        TimerNuma::ThreadAffinityGuard affinity;
+        for(unsigned node = 0; node < mShards.size(); ++node)
+        {
+            TimerNuma::bindThreadToNode(node);
+            mShards[node].scheduler->run();
+        }
+    }
+
+    // Stop all shards; see BasicTimerScheduler::stop.
+    void stop(const StopOptions& options = StopOptions())
+    {
+        for(Shard& shard : mShards)
+        {
+            shard.scheduler->stop(options);
+        }
+    }
+
+    // Stop all shards and remove all timers.
+    void reset()
+    {
+        stop(StopOptions());
+    }
+
+    // Add a timer on the calling thread's node. Returns 0 on failure.
+    TimerHandle addTimer(const std::chrono::milliseconds& period, TimerCallback callback, const TimerOptions& options = TimerOptions())
+    {
+        return addTimerOnNode(TimerNuma::currentNode(), period, std::move(callback), options);
+    }
+
+    // Add a timer on the given node (wrapped to the number of nodes). Returns 0 on failure.
+    TimerHandle addTimerOnNode(unsigned node, const std::chrono::milliseconds& period, TimerCallback callback, const TimerOptions& options = TimerOptions())
+    {
+        node %= static_cast<unsigned>(mShards.size());
+        const TimerTypes::TimerHandle local = mShards[node].scheduler->addTimer(period, [node, callback = std::move(callback)](TimerTypes::TimerHandle handle)
+        {
+            callback(makeHandle(node, handle));
+        }, options);
+        return makeHandle(node, local);
+    }
+
+    void removeTimer(TimerHandle handle)
+    {
+        const unsigned node = nodeOf(handle);
+        if(node < mShards.size())
+        {
+            mShards[node].scheduler->removeTimer(localHandleOf(handle));
+        }
+    }
+
+    bool isTimerActive(TimerHandle handle) const
+    {
+        const unsigned node = nodeOf(handle);
+        return node < mShards.size() && mShards[node].scheduler->isTimerActive(localHandleOf(handle));
+    }
+
+    unsigned nodeCount() const
+    {
+        return static_cast<unsigned>(mShards.size());
+    }
+
+    static unsigned nodeOf(TimerHandle handle)
+    {
+        return static_cast<unsigned>(static_cast<uint64_t>(handle) >> 32);
+    }
+
+    static TimerTypes::TimerHandle localHandleOf(TimerHandle handle)
+    {
+        return static_cast<TimerTypes::TimerHandle>(static_cast<uint32_t>(handle));
+    }
+
+    // The shard of a node, e.g. for groups, status() or memory placement checks
+    Scheduler& scheduler(unsigned node)
+    {
+        return *mShards[node].scheduler;
+    }
+
+    // Whether a node's timer memory is actually bound to it (false without NUMA support)
+    bool memoryBound(unsigned node) const
+    {
+        return mShards[node].memory->bound();
+    }
+
+private:
+    struct Shard
+    {
+        std::unique_ptr<TimerNuma::NodeMemoryResource> memory;
+        // Constructed in the node's memory
+        Scheduler* scheduler{nullptr};
+    };
+
+    static TimerHandle makeHandle(unsigned node, TimerTypes::TimerHandle local)
+    {
+        return (local == 0) ? 0 : static_cast<TimerHandle>((static_cast<uint64_t>(node) << 32) | static_cast<uint32_t>(local));
+    }
+
+    std::vector<Shard> mShards;
+};
@@ -0,0 +1,800 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "SharedTimerScheduler.hpp"
+#include "BasicTimerScheduler.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint32_t kMagic = 0x48524d54; // "TMRH"
+constexpr uint32_t kVersion = 3;
+constexpr size_t kCommandCapacity = 4096;
+constexpr size_t kExpirationCapacity = 4096;
+// How often the server looks for clients that exited without detaching
+constexpr std::chrono::seconds kReapInterval(1);
+
+enum CommandType : uint32_t
+{
+    kAddCommand,
+    kRemoveCommand,
+    kDetachCommand
+};
+
+enum ClientState : uint32_t
+{
+    kClientFree,
+    kClientAttached
+};
+
+struct Command
+{
+    uint32_t type;
+    uint32_t client;
+    int32_t timer;
+    uint32_t mode;
+    int64_t periodNanoseconds;
+    uint64_t token; // the client's attach token; commands with another are ignored
+};
+
+// Cell of the bounded multi-producer ring; its sequence tells producers and the consumer whose turn it is
+struct CommandCell
+{
+    std::atomic<uint64_t> sequence;
+    Command command;
+};
+
+struct ClientRecord
+{
+    std::atomic<uint32_t> state;
+    std::atomic<int32_t> pid; // 0 while the record is being claimed
+    std::atomic<uint64_t> droppedExpirations;
+    // Random token chosen by the client when it attaches, which its commands must carry. It keeps a
+    // stray or stale command (e.g. from an earlier client of the record) from touching the client's
+    // timers; it is no protection against a process that writes the segment at will.
+    std::atomic<uint64_t> token;
+    // Set by the server while one-shot expirations wait for room in the ring; the client then wakes
+    // the server after making room
+    std::atomic<uint32_t> backlogged;
+    // Position + 1 of the command cell the client is claiming or filling in, 0 when none; lets the
+    // server skip a cell whose client died before publishing it
+    std::atomic<uint64_t> claimingPosition;
+    // Futex word bumped by the server after delivering expirations; waiting is set while the client sleeps on it
+    alignas(64) std::atomic<uint32_t> wakeSequence;
+    std::atomic<uint32_t> waiting;
+    // Expiration ring: the server produces at head, the client consumes at tail
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    int32_t expirations[kExpirationCapacity];
+};
+
+struct SegmentHeader
+{
+    // Set last, once the segment is initialized
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t maxClients;
+    // Futex word bumped by clients after posting a command; sleeping is set while the server sleeps on it
+    alignas(64) std::atomic<uint32_t> wakeSequence;
+    std::atomic<uint32_t> sleeping;
+    alignas(64) std::atomic<uint64_t> enqueuePosition;
+    alignas(64) uint64_t dequeuePosition; // server only
+    CommandCell commands[kCommandCapacity];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit words");
+
+size_t segmentSize(size_t maxClients)
+{
+    return sizeof(SegmentHeader) + maxClients * sizeof(ClientRecord);
+}
+
+ClientRecord& clientAt(SegmentHeader* segment, size_t client)
+{
+    return reinterpret_cast<ClientRecord*>(segment + 1)[client];
+}
+
+// Shared (not process-private) futexes, since the words live in shared memory
+void futexWait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec relativeTimeout;
+    relativeTimeout.tv_sec = static_cast<time_t>(seconds.count());
+    relativeTimeout.tv_nsec = static_cast<long>((timeout - seconds).count());
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &relativeTimeout, nullptr, 0);
+}
+
+void futexWake(std::atomic<uint32_t>& word)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Wake the server if it is (about to go) to sleep
+void wakeServer(SegmentHeader* segment)
+{
+    segment->wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+    if(segment->sleeping.load(std::memory_order_seq_cst) != 0)
+    {
+        futexWake(segment->wakeSequence);
+    }
+}
+
+bool commandPending(const SegmentHeader* segment)
+{
+    const CommandCell& cell = segment->commands[segment->dequeuePosition % kCommandCapacity];
+    return cell.sequence.load(std::memory_order_acquire) == segment->dequeuePosition + 1;
+}
+
+} // namespace
+
+
+struct SharedTimerServer::Impl
+{
+    // Scheduler callback delivering an expiration to the client that owns the timer
+    struct Forward
+    {
+        Impl* server{nullptr};
+        uint32_t client{0};
+        int32_t timer{0};
+        bool oneShot{false};
+
+        void operator()(TimerTypes::TimerHandle) const
+        {
+            server->deliver(client, timer, oneShot);
+        }
+    };
+
+    using Scheduler = BasicTimerScheduler<std::chrono::steady_clock, TimerQueues::MultimapQueue, NullLock, Forward, InlineCallbackExecutor>;
+
+    static uint64_t timerKey(uint32_t client, int32_t timer)
+    {
+        return (uint64_t(client) << 32) | static_cast<uint32_t>(timer);
+    }
+
+    // Puts an expiration into the client's ring; returns false if the ring is full
+    bool push(uint32_t client, int32_t timer)
+    {
+        ClientRecord& record = clientAt(segment, client);
+        const uint64_t head = record.head.load(std::memory_order_relaxed);
+        if(head - record.tail.load(std::memory_order_seq_cst) >= kExpirationCapacity)
+        {
+            return false;
+        }
+        record.expirations[head % kExpirationCapacity] = timer;
+        record.head.store(head + 1, std::memory_order_release);
+        if(!clientsToWake[client])
+        {
+            clientsToWake[client] = true;
+            wakeList.push_back(client);
+        }
+        return true;
+    }
+
+    // A periodic expiration that finds the ring full is dropped (the timer fires again), but a one-shot
+    // one is the client's only notice that the timer is done: it waits in the backlog until there is room.
+    void deliver(uint32_t client, int32_t timer, bool oneShot)
+    {
+        if(!oneShot)
+        {
+            if(!push(client, timer))
+            {
+                clientAt(segment, client).droppedExpirations.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        timers.erase(timerKey(client, timer));
+        std::vector<int32_t>& backlog = backlogs[client];
+        if(backlog.empty() && push(client, timer))
+        {
+            return;
+        }
+        if(backlog.empty())
+        {
+            ++backloggedClients;
+            clientAt(segment, client).backlogged.store(1, std::memory_order_seq_cst);
+        }
+        backlog.push_back(timer);
+    }
+
+    // Moves backlogged one-shot expirations into the rings that have room again
+    void deliverBacklogs()
+    {
+        for(uint32_t client = 0; backloggedClients > 0 && client < segment->maxClients; ++client)
+        {
+            std::vector<int32_t>& backlog = backlogs[client];
+            if(backlog.empty())
+            {
+                continue;
+            }
+            size_t delivered = 0;
+            while(delivered < backlog.size() && push(client, backlog[delivered]))
+            {
+                ++delivered;
+            }
+            backlog.erase(backlog.begin(), backlog.begin() + static_cast<std::ptrdiff_t>(delivered));
+            if(backlog.empty())
+            {
+                clearBacklog(client);
+            }
+        }
+    }
+
+    // True if some client with a backlog has made room in its ring
+    bool backlogDeliverable() const
+    {
+        for(uint32_t client = 0; backloggedClients > 0 && client < segment->maxClients; ++client)
+        {
+            const ClientRecord& record = clientAt(segment, client);
+            if(!backlogs[client].empty() &&
+               record.head.load(std::memory_order_relaxed) - record.tail.load(std::memory_order_seq_cst) < kExpirationCapacity)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clearBacklog(uint32_t client)
+    {
+        if(clientAt(segment, client).backlogged.load(std::memory_order_relaxed) != 0)
+        {
+            --backloggedClients;
+            clientAt(segment, client).backlogged.store(0, std::memory_order_relaxed);
+        }
+        backlogs[client].clear();
+    }
+
+    void execute(const Command& command)
+    {
+        if(command.client >= segment->maxClients ||
+           command.token != clientAt(segment, command.client).token.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        switch(command.type)
+        {
+        case kAddCommand:
+        {
+            // Only the modes whose timers end with a delivery or a remove: the server would not learn
+            // when a backoff or manual timer is done, and calendar timers have no period
+            if(command.mode != static_cast<uint32_t>(TimerTypes::TimerMode::Periodic) &&
+               command.mode != static_cast<uint32_t>(TimerTypes::TimerMode::OneShot))
+            {
+                break;
+            }
+            TimerTypes::TimerOptions options;
+            options.mode = static_cast<TimerTypes::TimerMode>(command.mode);
+            const TimerTypes::TimerHandle handle = scheduler.addTimer(std::chrono::nanoseconds(command.periodNanoseconds),
+                Forward{this, command.client, command.timer, options.mode == TimerTypes::TimerMode::OneShot}, options);
+            if(handle != 0)
+            {
+                timers[timerKey(command.client, command.timer)] = handle;
+            }
+            break;
+        }
+        case kRemoveCommand:
+        {
+            const auto timerIter = timers.find(timerKey(command.client, command.timer));
+            if(timerIter != timers.end())
+            {
+                scheduler.removeTimer(timerIter->second);
+                timers.erase(timerIter);
+            }
+            break;
+        }
+        case kDetachCommand:
+            detach(command.client);
+            break;
+        }
+    }
+
+    void detach(uint32_t client)
+    {
+        for(auto timerIter = timers.begin(); timerIter != timers.end();)
+        {
+            if((timerIter->first >> 32) == client)
+            {
+                scheduler.removeTimer(timerIter->second);
+                timerIter = timers.erase(timerIter);
+            }
+            else
+            {
+                ++timerIter;
+            }
+        }
+        clearBacklog(client);
+        ClientRecord& record = clientAt(segment, client);
+        record.pid.store(0, std::memory_order_relaxed);
+        record.token.store(0, std::memory_order_relaxed);
+        record.claimingPosition.store(0, std::memory_order_relaxed);
+        record.state.store(kClientFree, std::memory_order_release);
+    }
+
+    void executeCommands()
+    {
+        while(commandPending(segment))
+        {
+            CommandCell& cell = segment->commands[segment->dequeuePosition % kCommandCapacity];
+            const Command command = cell.command;
+            cell.sequence.store(segment->dequeuePosition + kCommandCapacity, std::memory_order_release);
+            ++segment->dequeuePosition;
+            execute(command);
+        }
+    }
+
+    void wakeClients()
+    {
+        for(const uint32_t client : wakeList)
+        {
+            ClientRecord& record = clientAt(segment, client);
+            record.wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+            if(record.waiting.load(std::memory_order_seq_cst) != 0)
+            {
+                futexWake(record.wakeSequence);
+            }
+            clientsToWake[client] = false;
+        }
+        wakeList.clear();
+    }
+
+    bool clientGone(const ClientRecord& record) const
+    {
+        const int32_t pid = record.pid.load(std::memory_order_relaxed);
+        return record.state.load(std::memory_order_acquire) == kClientAttached && pid > 0 &&
+               ::kill(pid, 0) != 0 && errno == ESRCH;
+    }
+
+    // Skips the next command cell if it was claimed but never published by a client that is gone
+    // (killed between claiming the cell and publishing it), which would stall the ring for every
+    // client. Only the claiming client can publish a cell, so a cell that no live client is claiming
+    // stays unpublished for good.
+    bool skipAbandonedCommand()
+    {
+        const uint64_t position = segment->dequeuePosition;
+        if(commandPending(segment) || segment->enqueuePosition.load(std::memory_order_seq_cst) == position)
+        {
+            return false;
+        }
+        bool abandoned = false;
+        for(uint32_t client = 0; client < segment->maxClients; ++client)
+        {
+            ClientRecord& record = clientAt(segment, client);
+            if(record.state.load(std::memory_order_acquire) == kClientAttached &&
+               record.claimingPosition.load(std::memory_order_seq_cst) == position + 1)
+            {
+                if(!clientGone(record))
+                {
+                    return false; // a live client is still filling the cell in
+                }
+                abandoned = true;
+            }
+        }
+        if(!abandoned || commandPending(segment))
+        {
+            return false;
+        }
+        segment->commands[position % kCommandCapacity].sequence.store(position + kCommandCapacity, std::memory_order_release);
+        ++segment->dequeuePosition;
+        return true;
+    }
+
+    // Remove the timers of clients whose process is gone, after skipping the cells they left unpublished
+    void reapClients()
+    {
+        while(skipAbandonedCommand())
+        {
+            executeCommands();
+        }
+        for(uint32_t client = 0; client < segment->maxClients; ++client)
+        {
+            if(clientGone(clientAt(segment, client)))
+            {
+                detach(client);
+            }
+        }
+    }
+
+    std::string name;
+    SegmentHeader* segment{nullptr};
+    size_t size{0};
+    Scheduler scheduler;
+    // (client, client's timer) -> scheduler handle
+    std::unordered_map<uint64_t, TimerTypes::TimerHandle> timers;
+    // Per client: one-shot expirations waiting for room in its ring
+    std::vector<std::vector<int32_t>> backlogs;
+    size_t backloggedClients{0};
+    std::vector<bool> clientsToWake;
+    std::vector<uint32_t> wakeList;
+    std::atomic<bool> stopping{false};
+};
+
+SharedTimerServer::SharedTimerServer(const char* name, size_t maxClients) :
+    mImpl(std::make_unique<Impl>())
+{
+    const size_t size = segmentSize(maxClients);
+    const int fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0)
+    {
+        return;
+    }
+    void* mapping = MAP_FAILED;
+    if(::ftruncate(fd, static_cast<off_t>(size)) == 0)
+    {
+        mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        ::shm_unlink(name);
+        return;
+    }
+
+    SegmentHeader* const segment = new (mapping) SegmentHeader();
+    segment->version = kVersion;
+    segment->maxClients = static_cast<uint32_t>(maxClients);
+    for(size_t i = 0; i < kCommandCapacity; ++i)
+    {
+        segment->commands[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    for(size_t client = 0; client < maxClients; ++client)
+    {
+        new (&clientAt(segment, client)) ClientRecord();
+    }
+    segment->magic.store(kMagic, std::memory_order_release);
+
+    mImpl->name = name;
+    mImpl->segment = segment;
+    mImpl->size = size;
+    mImpl->clientsToWake.resize(maxClients);
+    mImpl->backlogs.resize(maxClients);
+    mImpl->wakeList.reserve(maxClients);
+}
+
+SharedTimerServer::~SharedTimerServer()
+{
+    reset();
+    if(mImpl->segment != nullptr)
+    {
+        ::munmap(mImpl->segment, mImpl->size);
+        ::shm_unlink(mImpl->name.c_str());
+    }
+}
+
+bool SharedTimerServer::valid() const
+{
+    return mImpl->segment != nullptr;
+}
+
+void SharedTimerServer::run()
+{
+    if(mImpl->segment != nullptr && !mThread.joinable())
+    {
+        mImpl->stopping.store(false, std::memory_order_relaxed);
+        mImpl->scheduler.start();
+        mThread = std::thread(&SharedTimerServer::threadLoop, this);
+    }
+}
+
+void SharedTimerServer::reset()
+{
+    if(mThread.joinable())
+    {
+        mImpl->stopping.store(true, std::memory_order_seq_cst);
+        mImpl->segment->wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+        futexWake(mImpl->segment->wakeSequence);
+        mThread.join();
+    }
+}
+
+void SharedTimerServer::threadLoop()
+{
+    Impl& server = *mImpl;
+    SegmentHeader* const segment = server.segment;
+    auto nextReap = std::chrono::steady_clock::now() + kReapInterval;
+
+    while(!server.stopping.load(std::memory_order_relaxed))
+    {
+        server.executeCommands();
+        server.deliverBacklogs();
+        server.scheduler.processTimeouts();
+        server.wakeClients();
+
+        auto now = std::chrono::steady_clock::now();
+        if(now >= nextReap)
+        {
+            server.reapClients();
+            nextReap = now + kReapInterval;
+        }
+
+        // Announce that the thread is going to sleep, then check for commands posted meanwhile
+        segment->sleeping.store(1, std::memory_order_seq_cst);
+        const uint32_t wakeSequence = segment->wakeSequence.load(std::memory_order_seq_cst);
+        if(!commandPending(segment) && !server.backlogDeliverable() && !server.stopping.load(std::memory_order_seq_cst))
+        {
+            auto wakeTime = nextReap;
+            const auto nextTimeout = server.scheduler.nextTimeout();
+            if(nextTimeout && *nextTimeout < wakeTime)
+            {
+                wakeTime = *nextTimeout;
+            }
+            now = std::chrono::steady_clock::now();
+            if(wakeTime > now)
+            {
+                futexWait(segment->wakeSequence, wakeSequence, wakeTime - now);
+            }
+        }
+        segment->sleeping.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Client mapping of the segment and the claimed client record
+struct SharedTimerClient::Mapping
+{
+    SegmentHeader* segment{nullptr};
+    size_t size{0};
+    uint32_t client{0};
+    uint64_t token{0};
+    ClientRecord* record{nullptr};
+};
+
+SharedTimerClient::SharedTimerClient(const char* name) :
+    mMapping(std::make_unique<Mapping>())
+{
+    const int fd = ::shm_open(name, O_RDWR, 0);
+    if(fd < 0)
+    {
+        return;
+    }
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    size_t size(0);
+    if(::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(SegmentHeader))
+    {
+        size = static_cast<size_t>(status.st_size);
+        mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        return;
+    }
+
+    SegmentHeader* const segment = static_cast<SegmentHeader*>(mapping);
+    if(segment->magic.load(std::memory_order_acquire) != kMagic ||
+       segment->version != kVersion || size < segmentSize(segment->maxClients))
+    {
+        ::munmap(mapping, size);
+        return;
+    }
+
+    // Claim a free client record
+    for(uint32_t client = 0; client < segment->maxClients; ++client)
+    {
+        ClientRecord& record = clientAt(segment, client);
+        uint32_t expected(kClientFree);
+        if(record.state.compare_exchange_strong(expected, kClientAttached, std::memory_order_acq_rel))
+        {
+            std::random_device random;
+            uint64_t token(0);
+            while(token == 0)
+            {
+                token = (uint64_t(random()) << 32) | random();
+            }
+            record.pid.store(static_cast<int32_t>(::getpid()), std::memory_order_relaxed);
+            record.token.store(token, std::memory_order_release);
+            record.droppedExpirations.store(0, std::memory_order_relaxed);
+            record.claimingPosition.store(0, std::memory_order_relaxed);
+            record.tail.store(record.head.load(std::memory_order_acquire), std::memory_order_release); // skip a previous client's leftovers
+            mMapping->segment = segment;
+            mMapping->size = size;
+            mMapping->client = client;
+            mMapping->token = token;
+            mMapping->record = &record;
+            return;
+        }
+    }
+    ::munmap(mapping, size);
+}
+
+SharedTimerClient::~SharedTimerClient()
+{
+    if(mMapping->segment != nullptr)
+    {
+        // The server frees the record once it has removed the timers; retry briefly if the ring is full
+        for(int attempt = 0; attempt < 1000 && !post(kDetachCommand, 0, 0, TimerMode::Periodic); ++attempt)
+        {
+            std::this_thread::yield();
+        }
+        ::munmap(mMapping->segment, mMapping->size);
+    }
+}
+
+bool SharedTimerClient::valid() const
+{
+    return mMapping->segment != nullptr;
+}
+
+bool SharedTimerClient::post(uint32_t type, uint32_t timer, int64_t periodNanoseconds, TimerMode mode)
+{
+    SegmentHeader* const segment = mMapping->segment;
+    ClientRecord* const record = mMapping->record;
+
+    // Claim a cell of the multi-producer ring; the position is announced before each attempt, so that
+    // the server can tell whose cell it is should this process die before publishing it
+    uint64_t position = segment->enqueuePosition.load(std::memory_order_relaxed);
+    CommandCell* cell;
+    while(1)
+    {
+        cell = &segment->commands[position % kCommandCapacity];
+        const int64_t difference = static_cast<int64_t>(cell->sequence.load(std::memory_order_acquire) - position);
+        if(difference == 0)
+        {
+            record->claimingPosition.store(position + 1, std::memory_order_seq_cst);
+            if(segment->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(difference < 0)
+        {
+            record->claimingPosition.store(0, std::memory_order_relaxed);
+            return false; // full
+        }
+        else
+        {
+            position = segment->enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->command = Command{type, mMapping->client, static_cast<int32_t>(timer), static_cast<uint32_t>(mode), periodNanoseconds, mMapping->token};
+    cell->sequence.store(position + 1, std::memory_order_release);
+    record->claimingPosition.store(0, std::memory_order_release);
+
+    wakeServer(segment);
+    return true;
+}
+
+SharedTimerClient::TimerHandle SharedTimerClient::addTimer(const std::chrono::milliseconds& period, TimerCallback callback, TimerMode mode)
+{
+    if(mMapping->segment == nullptr || (mode != TimerMode::Periodic && mode != TimerMode::OneShot))
+    {
+        return 0;
+    }
+
+    const TimerHandle handle = mNextHandle;
+    if(!post(kAddCommand, static_cast<uint32_t>(handle), std::chrono::duration_cast<std::chrono::nanoseconds>(period).count(), mode))
+    {
+        return 0;
+    }
+    mNextHandle = (mNextHandle == INT32_MAX) ? 1 : mNextHandle + 1;
+    mTimers[handle] = Timer{std::move(callback), mode};
+    return handle;
+}
+
+void SharedTimerClient::removeTimer(TimerHandle handle)
+{
+    const auto timerIter = mTimers.find(handle);
+    if(timerIter != mTimers.end())
+    {
+        // If the ring is full the server keeps the timer, but its expirations are ignored
+        post(kRemoveCommand, static_cast<uint32_t>(handle), 0, TimerMode::Periodic);
+        if(handle == mFiringTimer)
+        {
+            mFiringTimerRemoved = true; // erased once its callback has returned
+        }
+        else
+        {
+            mTimers.erase(timerIter);
+        }
+    }
+}
+
+size_t SharedTimerClient::poll()
+{
+    ClientRecord* const record = mMapping->record;
+    if(record == nullptr)
+    {
+        return 0;
+    }
+
+    size_t invokedCallbacks(0);
+    const uint64_t head = record->head.load(std::memory_order_acquire);
+    for(uint64_t tail = record->tail.load(std::memory_order_relaxed); tail != head; ++tail)
+    {
+        const TimerHandle handle = record->expirations[tail % kExpirationCapacity];
+        record->tail.store(tail + 1, std::memory_order_release);
+
+        const auto timerIter = mTimers.find(handle);
+        if(timerIter == mTimers.end())
+        {
+            continue; // removed while the expiration was in flight
+        }
+        ++invokedCallbacks;
+        if(timerIter->second.mode == TimerMode::OneShot)
+        {
+            const TimerCallback callback = std::move(timerIter->second.callback);
+            mTimers.erase(timerIter);
+            callback(handle);
+        }
+        else
+        {
+            // The node stays put while the callback adds timers; removing this timer is deferred
+            mFiringTimer = handle;
+            timerIter->second.callback(handle);
+            mFiringTimer = 0;
+            if(mFiringTimerRemoved)
+            {
+                mFiringTimerRemoved = false;
+                mTimers.erase(handle);
+            }
+        }
+    }
+
+    // One-shot expirations wait on the server's side while the ring is full; tell it there is room now
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(record->backlogged.load(std::memory_order_relaxed) != 0)
+    {
+        wakeServer(mMapping->segment);
+    }
+    return invokedCallbacks;
+}
+
+bool SharedTimerClient::wait(const std::chrono::milliseconds& timeout)
+{
+    ClientRecord* const record = mMapping->record;
+    if(record == nullptr)
+    {
+        return false;
+    }
+
+    record->waiting.store(1, std::memory_order_seq_cst);
+    const uint32_t wakeSequence = record->wakeSequence.load(std::memory_order_seq_cst);
+    if(record->head.load(std::memory_order_acquire) == record->tail.load(std::memory_order_relaxed))
+    {
+        futexWait(record->wakeSequence, wakeSequence, timeout);
+    }
+    record->waiting.store(0, std::memory_order_relaxed);
+    return record->head.load(std::memory_order_acquire) != record->tail.load(std::memory_order_relaxed);
+}
+
+uint64_t SharedTimerClient::droppedExpirations() const
+{
+    return (mMapping->record != nullptr) ? mMapping->record->droppedExpirations.load(std::memory_order_relaxed) : 0;
+}
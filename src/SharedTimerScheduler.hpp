@@ -0,0 +1,139 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "TimerTypes.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Timer service shared by the processes of a host (Linux): one server process runs a single
+// scheduler thread for the timers of every client process, instead of each process running its own.
+//
+// The server creates a POSIX shared-memory segment holding a lock-free multi-producer command ring
+// and one expiration ring per client. Clients add and remove timers by posting commands; the server
+// sleeps on a futex in the segment until a command arrives or a timer is due, and delivers each
+// expiration into the owning client's ring, waking the client through a futex of its own. Clients
+// invoke their callbacks from their own loop with poll() (and wait() to block until expirations arrive).
+// Clients that exit without detaching are reaped by the server, which also skips a command a client
+// was killed in the middle of posting (until then, about a second, later commands wait behind it).
+
+// Owns the segment and the scheduler thread.
+class SharedTimerServer
+{
+public:
+    // Creates the segment name (a shm_open name, e.g. "/timers") for up to maxClients clients; fails
+    // if the segment exists (a server that crashed leaves it behind until it is shm_unlink'ed).
+    explicit SharedTimerServer(const char* name, size_t maxClients = 64);
+
+    // Stops the thread and removes the segment.
+    ~SharedTimerServer();
+
+    SharedTimerServer(const SharedTimerServer&) = delete;
+    SharedTimerServer& operator=(const SharedTimerServer &) = delete;
+    SharedTimerServer(SharedTimerServer &&) = delete;
+    SharedTimerServer & operator=(SharedTimerServer &&) = delete;
+
+    // False if the segment could not be created
+    bool valid() const;
+
+    // Start the scheduler thread.
+    void run();
+
+    // Stop the scheduler thread; the clients' timers are kept until it is started again.
+    void reset();
+
+private:
+    struct Impl;
+
+    void threadLoop();
+
+    std::unique_ptr<Impl> mImpl;
+    std::thread mThread;
+};
+
+// Attachment of a process to a SharedTimerServer.
+class SharedTimerClient
+{
+public:
+    using TimerHandle = TimerTypes::TimerHandle;
+    using TimerCallback = std::function<void(TimerHandle handle)>;
+    using TimerMode = TimerTypes::TimerMode;
+
+    // Attaches to the segment created by a server; see valid().
+    explicit SharedTimerClient(const char* name);
+
+    // Detaches; the server removes the client's timers.
+    ~SharedTimerClient();
+
+    SharedTimerClient(const SharedTimerClient&) = delete;
+    SharedTimerClient& operator=(const SharedTimerClient &) = delete;
+    SharedTimerClient(SharedTimerClient &&) = delete;
+    SharedTimerClient & operator=(SharedTimerClient &&) = delete;
+
+    // False if there is no such server, or it has no free client slot
+    bool valid() const;
+
+    // Add a Periodic or OneShot timer; its callback is invoked from poll(). Returns 0 for any other
+    // mode, or if the command ring is full.
+    TimerHandle addTimer(const std::chrono::milliseconds& period, TimerCallback callback, TimerMode mode = TimerMode::Periodic);
+
+    // Remove a timer; an expiration already in flight is ignored.
+    void removeTimer(TimerHandle handle);
+
+    // Invoke the callbacks of the expirations received; returns the number of callbacks invoked.
+    size_t poll();
+
+    // Block until expirations have been received, or the timeout passes; returns true if there are any.
+    bool wait(const std::chrono::milliseconds& timeout);
+
+    // Number of periodic expirations the server dropped because this client's ring was full (the
+    // expiration of a one-shot timer waits on the server until poll() has made room).
+    uint64_t droppedExpirations() const;
+
+private:
+    struct Mapping;
+
+    struct Timer
+    {
+        TimerCallback callback;
+        TimerMode mode;
+    };
+
+    bool post(uint32_t type, uint32_t timer, int64_t periodNanoseconds, TimerMode mode);
+
+    std::unique_ptr<Mapping> mMapping;
+    std::unordered_map<TimerHandle, Timer> mTimers;
+    TimerHandle mNextHandle{1};
+    // Timer whose callback is running in poll(), and whether it was removed from within
+    TimerHandle mFiringTimer{0};
+    bool mFiringTimerRemoved{false};
+};
@@ -0,0 +1,338 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "TimerCalendar.hpp"
+#include "TimerQueues.hpp"
+
+#include <ctime>
+
+
+namespace
+{
+
+// Give up on expressions that match nothing within this many years (covers leap days)
+constexpr std::time_t kSearchLimitSeconds = std::time_t(8) * 366 * 24 * 3600;
+
+bool parseNumber(const char*& text, int& value)
+{
+    if(*text < '0' || *text > '9')
+    {
+        return false;
+    }
+    value = 0;
+    while(*text >= '0' && *text <= '9')
+    {
+        value = value * 10 + (*text - '0');
+        if(value > 1000)
+        {
+            return false;
+        }
+        ++text;
+    }
+    return true;
+}
+
+inline bool isSpace(char character)
+{
+    return character == ' ' || character == '\t';
+}
+
+// Parses one field into a mask of the values in [minimum, maximum]; any is set for a plain "*"
+bool parseField(const char*& text, int minimum, int maximum, uint64_t& mask, bool& any)
+{
+    mask = 0;
+    any = false;
+    while(1)
+    {
+        int first;
+        int last;
+        int step = 1;
+        const bool star = (*text == '*');
+        if(star)
+        {
+            first = minimum;
+            last = maximum;
+            ++text;
+        }
+        else
+        {
+            if(!parseNumber(text, first))
+            {
+                return false;
+            }
+            last = first;
+            if(*text == '-')
+            {
+                ++text;
+                if(!parseNumber(text, last))
+                {
+                    return false;
+                }
+            }
+        }
+        if(*text == '/')
+        {
+            ++text;
+            if(!parseNumber(text, step) || step == 0)
+            {
+                return false;
+            }
+        }
+        else if(star)
+        {
+            any = true;
+        }
+
+        if(first < minimum || last > maximum || first > last)
+        {
+            return false;
+        }
+        for(int value = first; value <= last; value += step)
+        {
+            mask |= uint64_t(1) << value;
+        }
+
+        if(*text != ',')
+        {
+            break;
+        }
+        ++text;
+    }
+    return *text == '\0' || isSpace(*text);
+}
+
+void skipSpace(const char*& text)
+{
+    while(isSpace(*text))
+    {
+        ++text;
+    }
+}
+
+// The lowest value >= from in the mask, or -1
+inline int nextValue(uint64_t mask, int from)
+{
+    if(from >= 64)
+    {
+        return -1;
+    }
+    uint64_t remaining = mask >> from;
+    if(remaining == 0)
+    {
+        return -1;
+    }
+    return from + TimerQueues::Detail::countTrailingZeros(remaining);
+}
+
+} // namespace
+
+
+std::optional<TimerCalendar::CronExpression> TimerCalendar::CronExpression::parse(const char* text, TimeZone zone)
+{
+    // Count the fields to tell whether there is a seconds field
+    int fieldCount = 0;
+    for(const char* position = text; *position != '\0'; )
+    {
+        skipSpace(position);
+        if(*position != '\0')
+        {
+            ++fieldCount;
+            while(*position != '\0' && !isSpace(*position))
+            {
+                ++position;
+            }
+        }
+    }
+    if(fieldCount != 5 && fieldCount != 6)
+    {
+        return std::nullopt;
+    }
+
+    CronExpression expression;
+    expression.mZone = zone;
+    uint64_t mask;
+    bool any;
+
+    skipSpace(text);
+    if(fieldCount == 6)
+    {
+        if(!parseField(text, 0, 59, expression.mSeconds, any))
+        {
+            return std::nullopt;
+        }
+        skipSpace(text);
+    }
+    else
+    {
+        expression.mSeconds = 1;
+    }
+    if(!parseField(text, 0, 59, expression.mMinutes, any))
+    {
+        return std::nullopt;
+    }
+    skipSpace(text);
+    if(!parseField(text, 0, 23, mask, any))
+    {
+        return std::nullopt;
+    }
+    expression.mHours = static_cast<uint32_t>(mask);
+    skipSpace(text);
+    if(!parseField(text, 1, 31, mask, expression.mAnyDayOfMonth))
+    {
+        return std::nullopt;
+    }
+    expression.mDaysOfMonth = static_cast<uint32_t>(mask);
+    skipSpace(text);
+    if(!parseField(text, 1, 12, mask, any))
+    {
+        return std::nullopt;
+    }
+    expression.mMonths = static_cast<uint16_t>(mask);
+    skipSpace(text);
+    if(!parseField(text, 0, 7, mask, expression.mAnyDayOfWeek))
+    {
+        return std::nullopt;
+    }
+    expression.mDaysOfWeek = static_cast<uint8_t>((mask | (mask >> 7)) & 0x7f); // 7 is Sunday
+    return expression;
+}
+
+bool TimerCalendar::CronExpression::matchesDay(int dayOfMonth, int dayOfWeek) const
+{
+    const bool dayOfMonthMatches = (mDaysOfMonth >> dayOfMonth) & 1;
+    const bool dayOfWeekMatches = (mDaysOfWeek >> dayOfWeek) & 1;
+    if(mAnyDayOfMonth || mAnyDayOfWeek)
+    {
+        return dayOfMonthMatches && dayOfWeekMatches;
+    }
+    return dayOfMonthMatches || dayOfWeekMatches;
+}
+
+std::optional<TimerCalendar::WallTimePoint> TimerCalendar::CronExpression::next(WallTimePoint after) const
+{
+    const bool utc = (mZone == TimeZone::Utc);
+    const auto breakDown = [utc](std::time_t time, std::tm& fields)
+    {
+        if(utc)
+        {
+            gmtime_r(&time, &fields);
+        }
+        else
+        {
+            localtime_r(&time, &fields);
+        }
+    };
+    // Within a day the DST flag is kept, so that stepping through a repeated local hour stays
+    // monotonic; a new day starts from whichever offset applies at midnight.
+    const auto normalize = [utc](std::tm& fields)
+    {
+        return utc ? timegm(&fields) : mktime(&fields);
+    };
+
+    const std::time_t start = std::chrono::system_clock::to_time_t(std::chrono::floor<std::chrono::seconds>(after)) + 1;
+    std::time_t time = start;
+    std::tm fields;
+    breakDown(time, fields);
+
+    while(time - start < kSearchLimitSeconds)
+    {
+        if(((mMonths >> (fields.tm_mon + 1)) & 1) == 0)
+        {
+            fields.tm_mon += 1;
+            fields.tm_mday = 1;
+            fields.tm_hour = fields.tm_min = fields.tm_sec = 0;
+            fields.tm_isdst = -1;
+        }
+        else if(!matchesDay(fields.tm_mday, fields.tm_wday))
+        {
+            fields.tm_mday += 1;
+            fields.tm_hour = fields.tm_min = fields.tm_sec = 0;
+            fields.tm_isdst = -1;
+        }
+        else
+        {
+            const int hour = nextValue(mHours, fields.tm_hour);
+            if(hour != fields.tm_hour)
+            {
+                if(hour < 0)
+                {
+                    fields.tm_mday += 1;
+                    fields.tm_hour = 0;
+                    fields.tm_isdst = -1;
+                }
+                else
+                {
+                    fields.tm_hour = hour;
+                }
+                fields.tm_min = fields.tm_sec = 0;
+            }
+            else
+            {
+                const int minute = nextValue(mMinutes, fields.tm_min);
+                if(minute != fields.tm_min)
+                {
+                    if(minute < 0)
+                    {
+                        fields.tm_hour += 1;
+                        fields.tm_min = 0;
+                    }
+                    else
+                    {
+                        fields.tm_min = minute;
+                    }
+                    fields.tm_sec = 0;
+                }
+                else
+                {
+                    const int second = nextValue(mSeconds, fields.tm_sec);
+                    if(second == fields.tm_sec)
+                    {
+                        return std::chrono::system_clock::from_time_t(time);
+                    }
+                    if(second < 0)
+                    {
+                        fields.tm_min += 1;
+                        fields.tm_sec = 0;
+                    }
+                    else
+                    {
+                        fields.tm_sec = second;
+                    }
+                }
+            }
+        }
+
+        const std::time_t advanced = normalize(fields);
+        if(advanced <= time)
+        {
+            // A local time that does not exist (DST gap) can map backwards; step past it instead
+            time += 1;
+        }
+        else
+        {
+            time = advanced;
+        }
+        breakDown(time, fields);
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,80 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Calendar (cron-style) expressions, for timers that fire at wall-clock times (see
+// BasicTimerScheduler::addCalendarTimer).
+//
+// An expression has five fields, "minute hour day-of-month month day-of-week", or six with a
+// leading seconds field. Each field is "*" or a comma separated list of values and ranges
+// ("a-b"), each optionally with a step ("*/15", "10-50/10"). Days of the week are 0-6 from
+// Sunday (7 is Sunday too). As in cron, when both day fields are restricted a day matching
+// either one matches. Examples: "* * * * *" every minute at :00, "30 2 * * *" daily at 02:30,
+// "0 */5 9-17 * * 1-5" every five minutes during office hours.
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace TimerCalendar
+{
+
+using WallTimePoint = std::chrono::system_clock::time_point;
+
+enum class TimeZone : uint8_t
+{
+    Utc,
+    Local
+};
+
+class CronExpression
+{
+public:
+    // Returns nullopt if the text is not a valid expression
+    static std::optional<CronExpression> parse(const char* text, TimeZone zone = TimeZone::Utc);
+
+    // The first matching time strictly after the given time (whole seconds), or nullopt if there
+    // is none within the next few years (e.g. "0 0 30 2 *")
+    std::optional<WallTimePoint> next(WallTimePoint after) const;
+
+    TimeZone zone() const { return mZone; }
+
+private:
+    CronExpression() = default;
+
+    bool matchesDay(int dayOfMonth, int dayOfWeek) const;
+
+    // Bit n is set for every value n the field matches
+    uint64_t mSeconds{0};
+    uint64_t mMinutes{0};
+    uint32_t mHours{0};
+    uint32_t mDaysOfMonth{0};
+    uint16_t mMonths{0};
+    uint8_t mDaysOfWeek{0};
+    bool mAnyDayOfMonth{false};
+    bool mAnyDayOfWeek{false};
+    TimeZone mZone{TimeZone::Utc};
+};
+
+} // namespace TimerCalendar
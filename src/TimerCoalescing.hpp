@@ -0,0 +1,259 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "TimerScheduler.hpp"
+#include "TimerTypes.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+
+// Debouncing and throttling of event bursts, each on a single Manual timer that is re-keyed with
+// rescheduleTimer() rather than added and removed per event. An event only records a timestamp
+// (and re-arms the timer if it is dormant), and the timestamp is re-checked when the timer
+// expires, so a burst of any size costs a few queue operations per delay rather than one add and
+// remove per event. Events may come from any thread; the action runs on the scheduler's thread.
+// An object must not be destroyed while its action is running.
+//
+// Scheduler is a BasicTimerScheduler with std::function-like callbacks, or ProcessTimerScheduler for
+// the process-wide TimerScheduler.
+
+namespace TimerCoalescing
+{
+
+// Instance interface to the static TimerScheduler (deadlines rounded up to milliseconds)
+struct ProcessTimerScheduler
+{
+    using TimerHandle = TimerScheduler::TimerHandle;
+
+    template<typename Rep, typename Period>
+    TimerHandle addTimer(const std::chrono::duration<Rep, Period>& period, TimerScheduler::TimerCallback callback, const TimerScheduler::TimerOptions& options)
+    {
+        return TimerScheduler::addTimer(std::chrono::ceil<std::chrono::milliseconds>(period), std::move(callback), options);
+    }
+
+    template<typename Rep, typename Period>
+    bool rescheduleTimer(TimerHandle handle, const std::chrono::duration<Rep, Period>& delay)
+    {
+        return TimerScheduler::rescheduleTimer(handle, std::chrono::ceil<std::chrono::milliseconds>(delay));
+    }
+
+    void removeTimer(TimerHandle handle)
+    {
+        TimerScheduler::removeTimer(handle);
+    }
+};
+
+namespace Detail
+{
+
+// Timer slot shared by Debouncer and Throttler: added on first use, then only rescheduled
+template<typename Scheduler, typename Clock>
+class CoalescingTimer
+{
+protected:
+    using TimerHandle = TimerTypes::TimerHandle;
+
+    explicit CoalescingTimer(Scheduler& scheduler) :
+        mScheduler(scheduler)
+    {
+    }
+
+    ~CoalescingTimer()
+    {
+        const TimerHandle handle = mHandle.load(std::memory_order_acquire);
+        if(handle != 0)
+        {
+            mScheduler.removeTimer(handle);
+        }
+    }
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    // Only called by whoever set the armed flag. Re-keys the timer, or adds one if there is none
+    // (or it is gone). If that fails (the scheduler is stopped, or at its hard capacity) the armed
+    // flag is cleared, so that the next event tries again; returns false then.
+    template<typename Expiry>
+    bool arm(int64_t delay, Expiry expiry)
+    {
+        const TimerHandle handle = mHandle.load(std::memory_order_acquire);
+        if(handle != 0 && mScheduler.rescheduleTimer(handle, std::chrono::nanoseconds(delay)))
+        {
+            return true;
+        }
+
+        TimerTypes::TimerOptions options;
+        options.mode = TimerTypes::TimerMode::Manual;
+        const TimerHandle added = mScheduler.addTimer(std::chrono::nanoseconds(delay), std::move(expiry), options);
+        mHandle.store(added, std::memory_order_release);
+        if(added == 0)
+        {
+            mArmed.store(false, std::memory_order_seq_cst);
+            return false;
+        }
+        return true;
+    }
+
+    Scheduler& mScheduler;
+    std::atomic<TimerHandle> mHandle{0};
+    std::atomic<bool> mArmed{false};
+};
+
+} // namespace Detail
+
+// Runs the action once no event has been triggered for the delay (trailing edge).
+template<typename Scheduler, typename Clock = std::chrono::steady_clock>
+class Debouncer : private Detail::CoalescingTimer<Scheduler, Clock>
+{
+public:
+    using Action = std::function<void()>;
+
+    Debouncer(Scheduler& scheduler, std::chrono::nanoseconds delay, Action action) :
+        Detail::CoalescingTimer<Scheduler, Clock>(scheduler),
+        mDelay(delay.count()),
+        mAction(std::move(action))
+    {
+    }
+
+    // Returns false if the timer could not be armed (the scheduler is stopped, or at its hard
+    // capacity); the action then only runs once a later trigger() succeeds.
+    bool trigger()
+    {
+        mLastTrigger.store(this->now(), std::memory_order_seq_cst);
+        if(!this->mArmed.exchange(true, std::memory_order_seq_cst))
+        {
+            return this->arm(mDelay, expiry());
+        }
+        return true;
+    }
+
+private:
+    auto expiry()
+    {
+        return [this](TimerTypes::TimerHandle handle) { onTimeout(handle); };
+    }
+
+    void onTimeout(TimerTypes::TimerHandle handle)
+    {
+        this->mHandle.store(handle, std::memory_order_release);
+
+        // Triggered again since the timer was armed: move the deadline (if that fails, the next
+        // trigger() arms anew)
+        const int64_t lastTrigger = mLastTrigger.load(std::memory_order_seq_cst);
+        const int64_t remaining = lastTrigger + mDelay - this->now();
+        if(remaining > 0)
+        {
+            this->arm(remaining, expiry());
+            return;
+        }
+
+        // Disarm; a trigger that still saw the timer armed is caught by the second look
+        this->mArmed.store(false, std::memory_order_seq_cst);
+        if(mLastTrigger.load(std::memory_order_seq_cst) != lastTrigger)
+        {
+            if(!this->mArmed.exchange(true, std::memory_order_seq_cst))
+            {
+                this->arm(mDelay, expiry());
+            }
+            return;
+        }
+        mAction();
+    }
+
+    const int64_t mDelay;
+    const Action mAction;
+    std::atomic<int64_t> mLastTrigger{0};
+};
+
+// Runs the action at most once per interval: right away for the first event, then once at the end
+// of each interval in which events were triggered (leading and trailing edge).
+template<typename Scheduler, typename Clock = std::chrono::steady_clock>
+class Throttler : private Detail::CoalescingTimer<Scheduler, Clock>
+{
+public:
+    using Action = std::function<void()>;
+
+    Throttler(Scheduler& scheduler, std::chrono::nanoseconds interval, Action action) :
+        Detail::CoalescingTimer<Scheduler, Clock>(scheduler),
+        mInterval(interval.count()),
+        mAction(std::move(action))
+    {
+    }
+
+    // Returns false if the timer could not be armed (the scheduler is stopped, or at its hard
+    // capacity); the action then only runs once a later trigger() succeeds.
+    bool trigger()
+    {
+        mPending.store(true, std::memory_order_seq_cst);
+        if(!this->mArmed.exchange(true, std::memory_order_seq_cst))
+        {
+            const int64_t wait = mLastRun.load(std::memory_order_relaxed) + mInterval - this->now();
+            return this->arm(std::max<int64_t>(0, wait), expiry());
+        }
+        return true;
+    }
+
+private:
+    auto expiry()
+    {
+        return [this](TimerTypes::TimerHandle handle) { onTimeout(handle); };
+    }
+
+    void onTimeout(TimerTypes::TimerHandle handle)
+    {
+        this->mHandle.store(handle, std::memory_order_release);
+
+        if(mPending.exchange(false, std::memory_order_seq_cst))
+        {
+            // Stay armed for an interval, to collect the events for the trailing run (if that fails,
+            // the next trigger() arms anew)
+            mLastRun.store(this->now(), std::memory_order_relaxed);
+            this->arm(mInterval, expiry());
+            mAction();
+            return;
+        }
+
+        // A quiet interval: disarm; a trigger that still saw the timer armed is caught by the second look
+        this->mArmed.store(false, std::memory_order_seq_cst);
+        if(mPending.load(std::memory_order_seq_cst) && !this->mArmed.exchange(true, std::memory_order_seq_cst))
+        {
+            this->arm(0, expiry());
+        }
+    }
+
+    const int64_t mInterval;
+    const Action mAction;
+    std::atomic<bool> mPending{false};
+    std::atomic<int64_t> mLastRun{std::numeric_limits<int64_t>::min() / 2};
+};
+
+} // namespace TimerCoalescing
@@ -0,0 +1,315 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Coroutine support for the TimerScheduler (requires C++20).
+
+#include "TimerScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace TimerCoroutines
+{
+
+// Exception thrown by co_await when its timer could not be added (the scheduler is not running, or
+// is at its hard capacity); the coroutine then was not suspended.
+class TimerUnavailableError : public std::runtime_error
+{
+public:
+    TimerUnavailableError() :
+        std::runtime_error("timer could not be added")
+    {
+    }
+};
+
+// Resumes the coroutine directly on the scheduler thread (i.e. from within the timer callback).
+struct InlineExecutor
+{
+    void operator()(std::coroutine_handle<> handle) const
+    {
+        handle.resume();
+    }
+};
+
+// Awaiter suspending the coroutine until a deadline; resumption happens through the executor, which
+// is any callable taking a std::coroutine_handle<>.
+// The awaiter lives in the awaiting coroutine's frame and its one-shot timer only captures a pointer
+// to it, so waiting does not allocate (the timer slot comes from the scheduler's pool).
+// co_await throws TimerUnavailableError if the timer could not be added, so that a retry loop
+// sleeping between attempts does not spin.
+template<typename Executor = InlineExecutor>
+class SleepAwaiter
+{
+public:
+    SleepAwaiter(std::chrono::steady_clock::time_point deadline, Executor executor) :
+        mDeadline(deadline),
+        mExecutor(std::move(executor))
+    {
+    }
+
+    bool await_ready() const
+    {
+        return mDeadline <= std::chrono::steady_clock::now();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        mHandle = handle;
+
+        const auto delay = std::chrono::ceil<std::chrono::milliseconds>(mDeadline - std::chrono::steady_clock::now());
+        TimerScheduler::TimerOptions options;
+        options.mode = TimerScheduler::TimerMode::OneShot;
+
+        // The coroutine may be resumed (and this awaiter destroyed) before addTimer returns,
+        // so nothing in this object may be touched after the call.
+        const TimerScheduler::TimerHandle timer = TimerScheduler::addTimer(
+            std::max(delay, std::chrono::milliseconds(0)),
+            [this](TimerScheduler::TimerHandle) { mExecutor(mHandle); },
+            options);
+
+        // If the timer could not be added, do not suspend at all (the callback never runs, so the
+        // awaiter is still there)
+        if(timer == 0)
+        {
+            mUnavailable = true;
+            return false;
+        }
+        return true;
+    }
+
+    void await_resume() const
+    {
+        if(mUnavailable)
+        {
+            throw TimerUnavailableError();
+        }
+    }
+
+private:
+    std::chrono::steady_clock::time_point mDeadline;
+    Executor mExecutor;
+    std::coroutine_handle<> mHandle;
+    bool mUnavailable{false};
+};
+
+template<typename Rep, typename Period, typename Executor = InlineExecutor>
+SleepAwaiter<Executor> sleep_for(const std::chrono::duration<Rep, Period>& duration, Executor executor = Executor())
+{
+    return SleepAwaiter<Executor>(std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>(duration), std::move(executor));
+}
+
+template<typename Duration, typename Executor = InlineExecutor>
+SleepAwaiter<Executor> sleep_until(const std::chrono::time_point<std::chrono::steady_clock, Duration>& deadline, Executor executor = Executor())
+{
+    return SleepAwaiter<Executor>(std::chrono::time_point_cast<std::chrono::steady_clock::duration>(deadline), std::move(executor));
+}
+
+namespace Detail
+{
+
+// Coroutine that starts immediately and destroys itself when done
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() noexcept { return DetachedTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+template<typename Awaitable>
+decltype(auto) getAwaiter(Awaitable&& awaitable)
+{
+    if constexpr(requires { std::forward<Awaitable>(awaitable).operator co_await(); })
+    {
+        return std::forward<Awaitable>(awaitable).operator co_await();
+    }
+    else if constexpr(requires { operator co_await(std::forward<Awaitable>(awaitable)); })
+    {
+        return operator co_await(std::forward<Awaitable>(awaitable));
+    }
+    else
+    {
+        return std::forward<Awaitable>(awaitable);
+    }
+}
+
+template<typename Awaitable>
+using AwaitResult = decltype(getAwaiter(std::declval<Awaitable>()).await_resume());
+
+// State shared by the timeout timer and the coroutine awaiting the wrapped awaitable; whichever
+// finishes first resumes the waiting coroutine.
+template<typename T, typename Executor>
+struct TimeoutState
+{
+    using Value = std::conditional_t<std::is_void_v<T>, bool, std::remove_cvref_t<T>>;
+
+    explicit TimeoutState(Executor executor) :
+        executor(std::move(executor))
+    {
+    }
+
+    // Returns true if the caller won the race and must resume the waiting coroutine
+    bool finish()
+    {
+        return !done.exchange(true, std::memory_order_acq_rel);
+    }
+
+    std::atomic<bool> done{false};
+    std::optional<Value> result;
+    std::exception_ptr exception;
+    std::coroutine_handle<> continuation;
+    TimerScheduler::TimerHandle timer{0};
+    Executor executor;
+};
+
+template<typename Awaitable, typename State>
+DetachedTask awaitWithState(Awaitable awaitable, std::shared_ptr<State> state)
+{
+    std::optional<typename State::Value> result;
+    std::exception_ptr exception;
+    try
+    {
+        if constexpr(std::is_void_v<AwaitResult<Awaitable>>)
+        {
+            co_await std::move(awaitable);
+            result.emplace(true);
+        }
+        else
+        {
+            result.emplace(co_await std::move(awaitable));
+        }
+    }
+    catch(...)
+    {
+        exception = std::current_exception();
+    }
+
+    if(state->finish())
+    {
+        TimerScheduler::removeTimer(state->timer);
+        state->result = std::move(result);
+        state->exception = exception;
+        state->executor(state->continuation);
+    }
+}
+
+} // namespace Detail
+
+// Awaiter racing an awaitable against a timeout. co_await yields std::optional<T> (bool for void
+// awaitables), which is empty (false) if the timeout expired first; exceptions of the awaitable
+// are rethrown. The awaitable itself cannot be cancelled, so on timeout it keeps running and its
+// result is discarded. Unlike sleeping, this allocates the shared state and a coroutine frame.
+// If the timeout timer could not be added, the awaitable is not started and co_await throws
+// TimerUnavailableError.
+template<typename Awaitable, typename Executor>
+class TimeoutAwaiter
+{
+public:
+    using State = Detail::TimeoutState<Detail::AwaitResult<Awaitable>, Executor>;
+
+    TimeoutAwaiter(Awaitable awaitable, std::chrono::milliseconds timeout, Executor executor) :
+        mAwaitable(std::move(awaitable)),
+        mTimeout(timeout),
+        mState(std::make_shared<State>(std::move(executor)))
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        mState->continuation = handle;
+
+        TimerScheduler::TimerOptions options;
+        options.mode = TimerScheduler::TimerMode::OneShot;
+        mState->timer = TimerScheduler::addTimer(mTimeout,
+            [state = mState](TimerScheduler::TimerHandle)
+            {
+                if(state->finish())
+                {
+                    state->executor(state->continuation);
+                }
+            },
+            options);
+        if(mState->timer == 0)
+        {
+            mUnavailable = true;
+            return false;
+        }
+
+        // The timer handle is set before the awaitable starts, so it can always remove the timer
+        Detail::awaitWithState(std::move(mAwaitable), mState);
+        return true;
+    }
+
+    auto await_resume()
+    {
+        if(mUnavailable)
+        {
+            throw TimerUnavailableError();
+        }
+        if(mState->exception)
+        {
+            std::rethrow_exception(mState->exception);
+        }
+        if constexpr(std::is_void_v<Detail::AwaitResult<Awaitable>>)
+        {
+            return mState->result.has_value();
+        }
+        else
+        {
+            return std::move(mState->result);
+        }
+    }
+
+private:
+    Awaitable mAwaitable;
+    std::chrono::milliseconds mTimeout;
+    std::shared_ptr<State> mState;
+    bool mUnavailable{false};
+};
+
+template<typename Awaitable, typename Rep, typename Period, typename Executor = InlineExecutor>
+TimeoutAwaiter<std::remove_cvref_t<Awaitable>, Executor> with_timeout(Awaitable&& awaitable, const std::chrono::duration<Rep, Period>& timeout, Executor executor = Executor())
+{
+    return TimeoutAwaiter<std::remove_cvref_t<Awaitable>, Executor>(std::forward<Awaitable>(awaitable), std::chrono::ceil<std::chrono::milliseconds>(timeout), std::move(executor));
+}
+
+} // namespace TimerCoroutines
@@ -0,0 +1,214 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// std::future integration for the TimerScheduler.
+
+#include "TimerScheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace TimerFutures
+{
+
+// Exception stored in a future whose timeout expired first.
+class TimeoutError : public std::runtime_error
+{
+public:
+    TimeoutError() :
+        std::runtime_error("timeout expired")
+    {
+    }
+};
+
+// Returns a future that becomes ready after the delay, fulfilled by a one-shot timer.
+// If the scheduler is not running, the future reports a broken promise.
+inline std::future<void> delay(const std::chrono::milliseconds& duration)
+{
+    // std::function needs a copyable callable, so the promise is shared
+    auto promise = std::make_shared<std::promise<void>>();
+    std::future<void> future = promise->get_future();
+
+    TimerScheduler::TimerOptions options;
+    options.mode = TimerScheduler::TimerMode::OneShot;
+    TimerScheduler::addTimer(duration, [promise](TimerScheduler::TimerHandle) { promise->set_value(); }, options);
+
+    return future;
+}
+
+// Promise that fails its future with TimeoutError unless it is fulfilled within the timeout.
+// Fulfilling it first removes the one-shot timer right away, so it does not linger in the queue.
+// If the timer cannot be added (the scheduler is not running, or is full), the future reports a
+// broken promise right away and set_value() returns false.
+template<typename T>
+class TimeoutPromise
+{
+public:
+    explicit TimeoutPromise(const std::chrono::milliseconds& timeout) :
+        mState(std::make_shared<State>())
+    {
+        TimerScheduler::TimerOptions options;
+        options.mode = TimerScheduler::TimerMode::OneShot;
+        mTimer = TimerScheduler::addTimer(timeout,
+            [state = mState](TimerScheduler::TimerHandle)
+            {
+                if(state->finish())
+                {
+                    state->promise.set_exception(std::make_exception_ptr(TimeoutError()));
+                }
+            },
+            options);
+        if(mTimer == 0)
+        {
+            mState->finish();
+            mState->promise.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+    TimeoutPromise(const TimeoutPromise&) = delete;
+    TimeoutPromise& operator=(const TimeoutPromise&) = delete;
+    TimeoutPromise(TimeoutPromise&&) = default;
+    TimeoutPromise& operator=(TimeoutPromise&&) = default;
+
+    // An abandoned promise does not need its timer anymore (its future reports a broken promise)
+    ~TimeoutPromise()
+    {
+        if(mState && mState->finish())
+        {
+            TimerScheduler::removeTimer(mTimer);
+        }
+    }
+
+    std::future<T> get_future()
+    {
+        return mState->promise.get_future();
+    }
+
+    // Returns false if the timeout already expired (the value is then discarded)
+    template<typename... Args>
+    bool set_value(Args&&... args)
+    {
+        if(!mState->finish())
+        {
+            return false;
+        }
+        TimerScheduler::removeTimer(mTimer);
+        mState->promise.set_value(std::forward<Args>(args)...);
+        return true;
+    }
+
+    // True once the promise is fulfilled, or its timeout expired
+    bool finished() const
+    {
+        return mState->done.load(std::memory_order_acquire);
+    }
+
+    // Returns false if the timeout already expired (the exception is then discarded)
+    bool set_exception(std::exception_ptr exception)
+    {
+        if(!mState->finish())
+        {
+            return false;
+        }
+        TimerScheduler::removeTimer(mTimer);
+        mState->promise.set_exception(std::move(exception));
+        return true;
+    }
+
+private:
+    struct State
+    {
+        // Returns true if the caller won the race between result and timeout
+        bool finish()
+        {
+            return !done.exchange(true, std::memory_order_acq_rel);
+        }
+
+        std::atomic<bool> done{false};
+        std::promise<T> promise;
+    };
+
+    std::shared_ptr<State> mState;
+    TimerScheduler::TimerHandle mTimer{0};
+};
+
+// Returns a future with the result of the given future, or TimeoutError if it is not ready within
+// the timeout; it becomes ready on its own, so it can be polled. std::future offers no completion
+// hook, so a periodic timer checks the source (without blocking) every pollInterval and hands its
+// result over to a TimeoutPromise, whose one-shot timer fails the returned future on timeout; the
+// timers go away as soon as either side has won. A deferred source future never becomes ready this
+// way and times out. If the timers cannot be added, the future reports a broken promise.
+// Use TimeoutPromise directly when the producing side is under your control.
+template<typename T>
+std::future<T> orTimeout(std::future<T> future, const std::chrono::milliseconds& timeout, const std::chrono::milliseconds& pollInterval = std::chrono::milliseconds(1))
+{
+    // std::function needs a copyable callable, so the promise and the source are shared
+    auto promise = std::make_shared<TimeoutPromise<T>>(timeout);
+    auto source = std::make_shared<std::future<T>>(std::move(future));
+    std::future<T> result = promise->get_future();
+
+    const TimerScheduler::TimerHandle timer = TimerScheduler::addTimer(pollInterval,
+        [promise, source](TimerScheduler::TimerHandle handle)
+        {
+            if(promise->finished())
+            {
+                TimerScheduler::removeTimer(handle);
+                return;
+            }
+            if(source->wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                return;
+            }
+            TimerScheduler::removeTimer(handle);
+            try
+            {
+                if constexpr(std::is_void_v<T>)
+                {
+                    source->get();
+                    promise->set_value();
+                }
+                else
+                {
+                    promise->set_value(source->get());
+                }
+            }
+            catch(...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        });
+    if(timer == 0)
+    {
+        promise->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+    }
+    return result;
+}
+
+} // namespace TimerFutures
@@ -0,0 +1,273 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "TimerMemory.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace
+{
+
+uintptr_t roundUp(uintptr_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+}
+
+// Bytes of the given (sorted, disjoint) address ranges that are backed by transparent huge pages,
+// from the AnonHugePages of the mappings in /proc/self/smaps that overlap them
+size_t anonHugeBytes(const std::vector<std::pair<uintptr_t, uintptr_t>>& ranges)
+{
+    FILE* const file = std::fopen("/proc/self/smaps", "r");
+    if(file == nullptr)
+    {
+        return 0;
+    }
+
+    size_t bytes = 0;
+    size_t overlap = 0; // of the current mapping with the ranges
+    char line[512];
+    bool lineStart = true;
+    while(std::fgets(line, sizeof(line), file) != nullptr)
+    {
+        // Skip the rest of an over-long line (a mapping's path)
+        const bool wholeLine = std::strchr(line, '\n') != nullptr;
+        if(!lineStart)
+        {
+            lineStart = wholeLine;
+            continue;
+        }
+        lineStart = wholeLine;
+
+        unsigned long begin = 0;
+        unsigned long end = 0;
+        size_t kilobytes = 0;
+        if(std::sscanf(line, "%lx-%lx", &begin, &end) == 2)
+        {
+            overlap = 0;
+            for(const auto& range : ranges)
+            {
+                const uintptr_t from = std::max<uintptr_t>(range.first, begin);
+                const uintptr_t to = std::min<uintptr_t>(range.second, end);
+                if(from < to)
+                {
+                    overlap += to - from;
+                }
+            }
+        }
+        else if(overlap > 0 && std::sscanf(line, "AnonHugePages: %zu kB", &kilobytes) == 1)
+        {
+            bytes += std::min(kilobytes * 1024, overlap);
+        }
+    }
+    std::fclose(file);
+    return bytes;
+}
+
+} // namespace
+
+namespace TimerMemory
+{
+
+HugePageMemoryResource::HugePageMemoryResource(bool enabled, std::pmr::memory_resource* upstream) :
+    mUpstream(upstream),
+    mEnabled(enabled)
+{
+}
+
+HugePageMemoryResource::~HugePageMemoryResource()
+{
+    while(!mRegions.empty())
+    {
+        unmapRegion(mRegions.begin());
+    }
+}
+
+void HugePageMemoryResource::setEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEnabled = enabled;
+}
+
+HugePageStatistics HugePageMemoryResource::statistics() const
+{
+    HugePageStatistics statistics;
+    std::vector<std::pair<uintptr_t, uintptr_t>> advised;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        statistics = mStatistics;
+        for(const auto& region : mRegions)
+        {
+            if(!region.second.hugeTlb)
+            {
+                advised.emplace_back(region.first, region.first + region.second.size);
+            }
+        }
+    }
+    if(!advised.empty())
+    {
+        statistics.transparentPages = anonHugeBytes(advised) / kHugePageSize;
+    }
+    return statistics;
+}
+
+void* HugePageMemoryResource::do_allocate(size_t bytes, size_t alignment)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(!mEnabled || alignment > kHugePageSize)
+    {
+        ++mStatistics.upstreamAllocations;
+        lock.unlock();
+        return mUpstream->allocate(bytes, alignment);
+    }
+
+    bytes = std::max<size_t>(bytes, 1);
+    uintptr_t start = roundUp(mCursor, alignment);
+    if(mCurrent == 0 || start + bytes > mCurrentEnd)
+    {
+        // A new region; a large allocation gets one of its own, leaving the current one in use
+        const size_t size = roundUp(bytes, kHugePageSize);
+        const uintptr_t region = mapRegion(size);
+        if(region == 0)
+        {
+            throw std::bad_alloc();
+        }
+        start = region;
+        if(size == kHugePageSize || mCurrent == 0)
+        {
+            if(mCurrent != 0 && mRegions[mCurrent].liveAllocations == 0)
+            {
+                unmapRegion(mRegions.find(mCurrent));
+            }
+            mCurrent = region;
+            mCurrentEnd = region + size;
+        }
+    }
+    if(start >= mCurrent && start < mCurrentEnd)
+    {
+        mCursor = start + bytes;
+    }
+
+    auto region = std::prev(mRegions.upper_bound(start));
+    ++region->second.liveAllocations;
+    mStatistics.bytesInUse += bytes;
+    return reinterpret_cast<void*>(start);
+}
+
+void HugePageMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    const uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+    auto region = mRegions.upper_bound(address);
+    if(region == mRegions.begin() || address >= std::prev(region)->first + std::prev(region)->second.size)
+    {
+        // Allocated while disabled
+        lock.unlock();
+        mUpstream->deallocate(pointer, bytes, alignment);
+        return;
+    }
+
+    --region;
+    mStatistics.bytesInUse -= std::max<size_t>(bytes, 1);
+    if(--region->second.liveAllocations == 0)
+    {
+        if(region->first == mCurrent)
+        {
+            mCursor = mCurrent; // carve it anew
+        }
+        else
+        {
+            unmapRegion(region);
+        }
+    }
+}
+
+bool HugePageMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+uintptr_t HugePageMemoryResource::mapRegion(size_t size)
+{
+    Region region{size, 0, true};
+    void* pages = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(pages == MAP_FAILED)
+    {
+        // No reserved huge pages left: ordinary pages, aligned to 2 MB so that the kernel can back
+        // them with transparent huge pages
+        region.hugeTlb = false;
+        void* const mapping = ::mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapping == MAP_FAILED)
+        {
+            return 0;
+        }
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(mapping);
+        const uintptr_t aligned = roundUp(begin, kHugePageSize);
+        if(aligned != begin)
+        {
+            ::munmap(mapping, aligned - begin);
+        }
+        ::munmap(reinterpret_cast<void*>(aligned + size), begin + kHugePageSize - aligned);
+        pages = reinterpret_cast<void*>(aligned);
+        ::madvise(pages, size, MADV_HUGEPAGE);
+    }
+
+    if(region.hugeTlb)
+    {
+        mStatistics.hugeTlbPages += size / kHugePageSize;
+    }
+    else
+    {
+        mStatistics.advisedPages += size / kHugePageSize;
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(pages);
+    mRegions.emplace(start, region);
+    return start;
+}
+
+void HugePageMemoryResource::unmapRegion(std::map<uintptr_t, Region>::iterator region)
+{
+    ::munmap(reinterpret_cast<void*>(region->first), region->second.size);
+    if(region->second.hugeTlb)
+    {
+        mStatistics.hugeTlbPages -= region->second.size / kHugePageSize;
+    }
+    else
+    {
+        mStatistics.advisedPages -= region->second.size / kHugePageSize;
+    }
+    if(region->first == mCurrent)
+    {
+        mCurrent = mCursor = mCurrentEnd = 0;
+    }
+    mRegions.erase(region);
+}
+
+} // namespace TimerMemory
@@ -0,0 +1,106 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+// Memory for schedulers holding millions of timers: a memory resource backed by 2 MB huge pages,
+// for use as the upstream of a BasicTimerScheduler (which takes its timer table, holding the
+// callbacks, and its node pool from the upstream), so that expiry walks over the timers cost
+// far fewer TLB misses.
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+
+namespace TimerMemory
+{
+
+struct HugePageStatistics
+{
+    // 2 MB pages currently mapped with MAP_HUGETLB (from the reserved pool, see /proc/sys/vm/nr_hugepages)
+    size_t hugeTlbPages{0};
+    // 2 MB regions mapped with ordinary pages and advised as transparent huge pages (MADV_HUGEPAGE),
+    // when the reserved pool was exhausted; the advice alone does not make them huge pages
+    size_t advisedPages{0};
+    // 2 MB pages of the advised regions that the kernel currently backs with transparent huge pages
+    // (their AnonHugePages in /proc/self/smaps, read by statistics())
+    size_t transparentPages{0};
+    // Bytes currently handed out from huge pages
+    size_t bytesInUse{0};
+    // Allocations passed to the upstream resource (while disabled, or too strictly aligned)
+    size_t upstreamAllocations{0};
+};
+
+// Carves allocations out of 2 MB aligned regions, mapping each with MAP_HUGETLB or, if that fails,
+// with ordinary pages advised with MADV_HUGEPAGE. A region is unmapped once everything carved out
+// of it has been deallocated. While disabled, allocations come from the upstream resource instead
+// (and go back to it), so the resource can be switched on before a scheduler reserves its storage.
+// Thread-safe; the schedulers' pools only call it to grow.
+class HugePageMemoryResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t kHugePageSize = size_t(2) << 20;
+
+    explicit HugePageMemoryResource(bool enabled = true, std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    ~HugePageMemoryResource() override;
+
+    HugePageMemoryResource(const HugePageMemoryResource&) = delete;
+    HugePageMemoryResource& operator=(const HugePageMemoryResource &) = delete;
+
+    // Whether later allocations come from huge pages
+    void setEnabled(bool enabled);
+
+    // Reads /proc/self/smaps to find out how many of the advised pages are huge pages
+    HugePageStatistics statistics() const;
+
+private:
+    struct Region
+    {
+        size_t size;
+        size_t liveAllocations;
+        bool hugeTlb;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    // Maps a region of at least the given size; returns its start, or 0 on failure
+    uintptr_t mapRegion(size_t size);
+    void unmapRegion(std::map<uintptr_t, Region>::iterator region);
+
+    std::pmr::memory_resource* mUpstream;
+    mutable std::mutex mMutex;
+    bool mEnabled;
+    // Regions by start address; allocations are carved from the current one
+    std::map<uintptr_t, Region> mRegions;
+    uintptr_t mCurrent{0};
+    uintptr_t mCursor{0};
+    uintptr_t mCurrentEnd{0};
+    HugePageStatistics mStatistics;
+};
+
+} // namespace TimerMemory
@@ -0,0 +1,195 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "TimerNuma.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr size_t kBitsPerWord = sizeof(unsigned long) * 8;
+// Large enough for the CPU and node masks of any current machine
+constexpr size_t kMaskWords = 64;
+
+// Parses a kernel list such as "0-3,8-11" (see cpuset(7))
+std::vector<unsigned> parseList(const std::string& text)
+{
+    std::vector<unsigned> values;
+    const char* position = text.c_str();
+    while(*position != '\0' && *position != '\n')
+    {
+        char* end;
+        const unsigned long first = std::strtoul(position, &end, 10);
+        if(end == position)
+        {
+            break;
+        }
+        unsigned long last = first;
+        if(*end == '-')
+        {
+            position = end + 1;
+            last = std::strtoul(position, &end, 10);
+        }
+        for(unsigned long value = first; value <= last && value < kMaskWords * kBitsPerWord; ++value)
+        {
+            values.push_back(static_cast<unsigned>(value));
+        }
+        position = (*end == ',') ? end + 1 : end;
+    }
+    return values;
+}
+
+std::string readFile(const char* path)
+{
+    std::string text;
+    if(FILE* const file = std::fopen(path, "r"))
+    {
+        char buffer[4096];
+        size_t length;
+        while((length = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            text.append(buffer, length);
+        }
+        std::fclose(file);
+    }
+    return text;
+}
+
+size_t pageSize()
+{
+    static const size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+} // namespace
+
+namespace TimerNuma
+{
+
+unsigned nodeCount()
+{
+    static const unsigned count = []
+    {
+        const std::vector<unsigned> nodes = parseList(readFile("/sys/devices/system/node/online"));
+        return nodes.empty() ? 1u : nodes.back() + 1;
+    }();
+    return count;
+}
+
+unsigned currentNode()
+{
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if(::getcpu(&cpu, &node) != 0 || node >= nodeCount())
+    {
+        return 0;
+    }
+    return node;
+}
+
+std::vector<unsigned> cpusOfNode(unsigned node)
+{
+    const std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    return parseList(readFile(path.c_str()));
+}
+
+bool bindThreadToNode(unsigned node)
+{
+    const std::vector<unsigned> cpus = cpusOfNode(node);
+    if(cpus.empty())
+    {
+        return false;
+    }
+    unsigned long mask[kMaskWords] = {};
+    for(const unsigned cpu : cpus)
+    {
+        mask[cpu / kBitsPerWord] |= 1UL << (cpu % kBitsPerWord);
+    }
+    return ::sched_setaffinity(0, sizeof(mask), reinterpret_cast<cpu_set_t*>(mask)) == 0;
+}
+
+ThreadAffinityGuard::ThreadAffinityGuard() :
+    mMask(kMaskWords)
+{
+    mValid = ::sched_getaffinity(0, mMask.size() * sizeof(unsigned long), reinterpret_cast<cpu_set_t*>(mMask.data())) == 0;
+}
+
+ThreadAffinityGuard::~ThreadAffinityGuard()
+{
+    if(mValid)
+    {
+        ::sched_setaffinity(0, mMask.size() * sizeof(unsigned long), reinterpret_cast<cpu_set_t*>(mMask.data()));
+    }
+}
+
+NodeMemoryResource::NodeMemoryResource(unsigned node) :
+    mNode(node)
+{
+}
+
+void* NodeMemoryResource::do_allocate(size_t bytes, size_t alignment)
+{
+    if(alignment > pageSize())
+    {
+        throw std::bad_alloc();
+    }
+    const size_t length = (std::max<size_t>(bytes, 1) + pageSize() - 1) & ~(pageSize() - 1);
+    void* const pages = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pages == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    // Bound before first touch, so the pages are allocated on the node
+    unsigned long nodeMask[kMaskWords] = {};
+    nodeMask[mNode / kBitsPerWord] = 1UL << (mNode % kBitsPerWord);
+    if(::syscall(SYS_mbind, pages, length, MPOL_BIND, nodeMask, kMaskWords * kBitsPerWord, 0) != 0)
+    {
+        mBound = false;
+    }
+    return pages;
+}
+
+void NodeMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t)
+{
+    const size_t length = (std::max<size_t>(bytes, 1) + pageSize() - 1) & ~(pageSize() - 1);
+    ::munmap(pointer, length);
+}
+
+bool NodeMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+} // namespace TimerNuma
@@ -0,0 +1,88 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+// NUMA placement for schedulers (see NumaTimerScheduler.hpp): the machine's nodes, binding threads
+// to a node's CPUs, and memory bound to a node. Read from /sys and set with plain system calls, so
+// no libnuma is needed; on a machine (or kernel) without NUMA everything is node 0.
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace TimerNuma
+{
+
+// The number of nodes (at least 1)
+unsigned nodeCount();
+
+// The node of the CPU the calling thread runs on (cheap: getcpu is served by the vDSO)
+unsigned currentNode();
+
+// The CPUs of a node (empty if it has none, or the topology is unknown)
+std::vector<unsigned> cpusOfNode(unsigned node);
+
+// Restricts the calling thread to the CPUs of a node; threads it starts afterwards inherit this.
+// Returns false if the node has no CPUs or the affinity could not be set.
+bool bindThreadToNode(unsigned node);
+
+// Saves the calling thread's CPU affinity, and restores it on destruction
+class ThreadAffinityGuard
+{
+public:
+    ThreadAffinityGuard();
+    ~ThreadAffinityGuard();
+
+    ThreadAffinityGuard(const ThreadAffinityGuard&) = delete;
+    ThreadAffinityGuard& operator=(const ThreadAffinityGuard &) = delete;
+
+private:
+    std::vector<unsigned long> mMask;
+    bool mValid{false};
+};
+
+// Memory resource handing out whole pages bound to a node (mbind), for use as the upstream of a
+// scheduler's pools: the pools request large blocks, so the page granularity costs little. If the
+// binding fails (no NUMA support) the pages are still handed out, placed by first touch.
+class NodeMemoryResource : public std::pmr::memory_resource
+{
+public:
+    explicit NodeMemoryResource(unsigned node);
+
+    unsigned node() const { return mNode; }
+
+    // Whether the pages handed out so far are all bound to the node
+    bool bound() const { return mBound; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    unsigned mNode;
+    bool mBound{true};
+};
+
+} // namespace TimerNuma
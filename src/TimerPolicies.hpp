@@ -0,0 +1,88 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Lock, executor and tracer policies for BasicTimerScheduler.
+
+#include "TimerTypes.hpp"
+
+#include <array>
+
+// Lock that does nothing, for schedulers only ever used from a single thread. Such a scheduler
+// has no thread of its own; it is driven with processTimeouts() from its owner's loop.
+struct NullLock
+{
+    void lock() noexcept {}
+    bool try_lock() noexcept { return true; }
+    void unlock() noexcept {}
+};
+
+// Invokes callbacks directly on the thread processing the timeouts. An executor is called with
+// the timer's callback and handle, and must invoke (or copy) the callback before returning. If it
+// returns bool, that is the callback's result: true ends a Backoff timer (see TimerMode).
+struct InlineCallbackExecutor
+{
+    template<typename Callback>
+    auto operator()(Callback& callback, TimerTypes::TimerHandle handle) const -> decltype(callback(handle))
+    {
+        return callback(handle);
+    }
+};
+
+// Dispatches each priority class to an executor of its own (e.g. critical timers inline, bulk timers
+// to a worker pool), so that a burst of bulk callbacks cannot hold up critical ones. An executor
+// that takes the priority as a third argument is called with it.
+template<typename Executor>
+struct PriorityLaneExecutor
+{
+    std::array<Executor, TimerTypes::kPriorityClasses> lanes;
+
+    // Lanes taking the priority are preferred (int binds before long)
+    template<typename Callback>
+    static auto invoke(Executor& lane, Callback& callback, TimerTypes::TimerHandle handle, TimerTypes::TimerPriority priority, int) -> decltype(lane(callback, handle, priority))
+    {
+        return lane(callback, handle, priority);
+    }
+
+    template<typename Callback>
+    static auto invoke(Executor& lane, Callback& callback, TimerTypes::TimerHandle handle, TimerTypes::TimerPriority, long) -> decltype(lane(callback, handle))
+    {
+        return lane(callback, handle);
+    }
+
+    template<typename Callback>
+    auto operator()(Callback& callback, TimerTypes::TimerHandle handle, TimerTypes::TimerPriority priority) -> decltype(invoke(lanes[0], callback, handle, priority, 0))
+    {
+        return invoke(lanes[static_cast<size_t>(priority)], callback, handle, priority, 0);
+    }
+};
+
+// Records nothing; tracing compiles out. A tracer is called with every TraceEvent, from whichever
+// thread caused it (see TimerTrace::RingTracer).
+struct NullTracer
+{
+    void record(TimerTypes::TraceEvent, TimerTypes::TimerHandle, int64_t = 0, TimerTypes::TimerMode = TimerTypes::TimerMode::Periodic) const noexcept
+    {
+    }
+};
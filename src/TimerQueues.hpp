@@ -0,0 +1,1613 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Queue policies for BasicTimerScheduler.
+//
+// A queue orders timer slots by deadline (in ticks of the scheduler's clock) and provides:
+//   explicit Queue(std::pmr::memory_resource* resource)
+//   static constexpr size_t kCapacity      maximum number of entries (and slot index bound)
+//   static constexpr size_t kNodeBytes     bytes each entry takes from the resource in small node
+//                                          allocations (the scheduler reserves these for it)
+//   void reserve(size_t capacity)
+//   bool push(Deadline deadline, Slot slot)   false if the queue is full
+//   bool pushBack(Deadline deadline, Slot slot)   push, for a deadline no earlier than any queued one
+//                                                  (amortized O(1); used for bulk loading)
+//   void erase(Slot slot)                     slot must be queued
+//   bool empty() const; size_t size() const
+//   Slot top() const; Deadline topDeadline() const   topDeadline may be a lower bound of the earliest
+//                                                    deadline (the scheduler then just wakes up early),
+//                                                    and top() then any of the earliest entries
+//   void popExpired(Deadline now, Output output)   removes and outputs (slot, deadline) of all entries
+//                                                  due at now, in order
+//   void forEach(Visitor visitor) const            visits (slot, deadline) of every entry
+//   void clear()
+// Output and Visitor must not modify the queue.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define TIMER_QUEUES_X86_KERNELS 1
+#endif
+
+namespace TimerQueues
+{
+
+using Deadline = int64_t;
+using Slot = uint32_t;
+
+namespace Detail
+{
+
+// Bit scans of a value != 0
+inline int countTrailingZeros(uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int count = 0;
+    for(; (value & 1) == 0; value >>= 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+inline int countLeadingZeros(uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(value);
+#else
+    int count = 0;
+    for(; (value & (uint64_t(1) << 63)) == 0; value <<= 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Number of bits needed to represent value (0 for 0)
+inline int bitWidth(uint64_t value)
+{
+    return value == 0 ? 0 : 64 - countLeadingZeros(value);
+}
+
+} // namespace Detail
+
+// Ordered multimap of deadline -> slot; remembers each slot's node for O(log n) erase.
+// Entries with equal deadlines are kept in insertion order.
+class MultimapQueue
+{
+public:
+    static constexpr size_t kCapacity = SIZE_MAX;
+    // A tree node: the entry plus its color and three links
+    static constexpr size_t kNodeBytes = sizeof(std::pair<const Deadline, Slot>) + 4 * sizeof(void*);
+
+    explicit MultimapQueue(std::pmr::memory_resource* resource) :
+        mMap(resource),
+        mPositions(resource)
+    {
+    }
+
+    void reserve(size_t capacity)
+    {
+        mPositions.reserve(capacity);
+    }
+
+    bool push(Deadline deadline, Slot slot)
+    {
+        if(slot >= mPositions.size())
+        {
+            mPositions.resize(slot + 1);
+        }
+        mPositions[slot] = mMap.emplace(deadline, slot);
+        return true;
+    }
+
+    bool pushBack(Deadline deadline, Slot slot)
+    {
+        if(slot >= mPositions.size())
+        {
+            mPositions.resize(slot + 1);
+        }
+        mPositions[slot] = mMap.emplace_hint(mMap.end(), deadline, slot);
+        return true;
+    }
+
+    void erase(Slot slot)
+    {
+        mMap.erase(mPositions[slot]);
+    }
+
+    bool empty() const
+    {
+        return mMap.empty();
+    }
+
+    size_t size() const
+    {
+        return mMap.size();
+    }
+
+    Slot top() const
+    {
+        return mMap.begin()->second;
+    }
+
+    Deadline topDeadline() const
+    {
+        return mMap.begin()->first;
+    }
+
+    template<typename Output>
+    void popExpired(Deadline now, Output&& output)
+    {
+        auto iter = mMap.begin();
+        for(; iter != mMap.end() && iter->first <= now; ++iter)
+        {
+            output(iter->second, iter->first);
+        }
+        mMap.erase(mMap.begin(), iter);
+    }
+
+    template<typename Visitor>
+    void forEach(Visitor&& visitor) const
+    {
+        for(const auto& entry : mMap)
+        {
+            visitor(entry.second, entry.first);
+        }
+    }
+
+    void clear()
+    {
+        mMap.clear();
+    }
+
+private:
+    using Map = std::pmr::multimap<Deadline, Slot>;
+
+    Map mMap;
+    std::pmr::vector<Map::iterator> mPositions;
+};
+
+// Binary heap in fixed arrays, for a bounded number of timers without any dynamic allocation
+// (e.g. embedded use). The scheduler never hands out slots beyond Capacity.
+template<size_t Capacity>
+class FixedHeapQueue
+{
+public:
+    static constexpr size_t kCapacity = Capacity;
+    static constexpr size_t kNodeBytes = 0;
+
+    explicit FixedHeapQueue(std::pmr::memory_resource*)
+    {
+    }
+
+    void reserve(size_t)
+    {
+    }
+
+    bool push(Deadline deadline, Slot slot)
+    {
+        if(mSize == Capacity)
+        {
+            return false;
+        }
+        mHeap[mSize] = Entry{deadline, slot};
+        mPositions[slot] = mSize;
+        siftUp(mSize++);
+        return true;
+    }
+
+    bool pushBack(Deadline deadline, Slot slot)
+    {
+        // Appending in ascending order keeps the array a valid heap, so no sifting is needed
+        if(mSize == Capacity)
+        {
+            return false;
+        }
+        place(mSize++, Entry{deadline, slot});
+        return true;
+    }
+
+    void erase(Slot slot)
+    {
+        removeAt(mPositions[slot]);
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    Slot top() const
+    {
+        return mHeap[0].slot;
+    }
+
+    Deadline topDeadline() const
+    {
+        return mHeap[0].deadline;
+    }
+
+    template<typename Output>
+    void popExpired(Deadline now, Output&& output)
+    {
+        while(mSize > 0 && mHeap[0].deadline <= now)
+        {
+            output(mHeap[0].slot, mHeap[0].deadline);
+            removeAt(0);
+        }
+    }
+
+    template<typename Visitor>
+    void forEach(Visitor&& visitor) const
+    {
+        for(size_t i = 0; i < mSize; ++i)
+        {
+            visitor(mHeap[i].slot, mHeap[i].deadline);
+        }
+    }
+
+    void clear()
+    {
+        mSize = 0;
+    }
+
+private:
+    struct Entry
+    {
+        Deadline deadline;
+        Slot slot;
+    };
+
+    void place(size_t index, const Entry& entry)
+    {
+        mHeap[index] = entry;
+        mPositions[entry.slot] = index;
+    }
+
+    void siftUp(size_t index)
+    {
+        const Entry entry = mHeap[index];
+        while(index > 0)
+        {
+            const size_t parent = (index - 1) / 2;
+            if(mHeap[parent].deadline <= entry.deadline)
+            {
+                break;
+            }
+            place(index, mHeap[parent]);
+            index = parent;
+        }
+        place(index, entry);
+    }
+
+    void siftDown(size_t index)
+    {
+        const Entry entry = mHeap[index];
+        while(true)
+        {
+            size_t child = 2 * index + 1;
+            if(child >= mSize)
+            {
+                break;
+            }
+            if(child + 1 < mSize && mHeap[child + 1].deadline < mHeap[child].deadline)
+            {
+                ++child;
+            }
+            if(entry.deadline <= mHeap[child].deadline)
+            {
+                break;
+            }
+            place(index, mHeap[child]);
+            index = child;
+        }
+        place(index, entry);
+    }
+
+    void removeAt(size_t index)
+    {
+        --mSize;
+        if(index != mSize)
+        {
+            place(index, mHeap[mSize]);
+            if(index > 0 && mHeap[index].deadline < mHeap[(index - 1) / 2].deadline)
+            {
+                siftUp(index);
+            }
+            else
+            {
+                siftDown(index);
+            }
+        }
+    }
+
+    std::array<Entry, Capacity> mHeap;
+    std::array<size_t, Capacity> mPositions;
+    size_t mSize{0};
+};
+
+// Hierarchical timing wheel with O(1) push and erase, for deadlines rounded up to Resolution clock
+// ticks (default: 1 ms of a nanosecond clock). Each level has 64 buckets, and a deadline is filed
+// at the level of the highest base-64 digit in which it differs from the wheel's current tick;
+// buckets are cascaded to lower levels as time reaches them. Eleven levels cover every int64 value.
+// Due timers come out in order of their rounded deadlines; topDeadline() is the start of the
+// earliest occupied bucket.
+template<Deadline Resolution = 1000000>
+class TimerWheelQueue
+{
+public:
+    static constexpr size_t kCapacity = SIZE_MAX;
+    static constexpr size_t kNodeBytes = 0;
+
+    explicit TimerWheelQueue(std::pmr::memory_resource* resource) :
+        mNodes(resource)
+    {
+        mBuckets.fill(kNone);
+        mOccupied.fill(0);
+    }
+
+    void reserve(size_t capacity)
+    {
+        mNodes.reserve(capacity);
+    }
+
+    bool push(Deadline deadline, Slot slot)
+    {
+        if(slot >= mNodes.size())
+        {
+            mNodes.resize(slot + 1);
+        }
+        Node& node = mNodes[slot];
+        node.deadline = deadline;
+        node.tick = deadline / Resolution + (deadline % Resolution > 0 ? 1 : 0); // round up
+        file(slot);
+        ++mSize;
+        return true;
+    }
+
+    bool pushBack(Deadline deadline, Slot slot)
+    {
+        return push(deadline, slot);
+    }
+
+    void erase(Slot slot)
+    {
+        unlink(slot);
+        --mSize;
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    Slot top() const
+    {
+        return mBuckets[earliestBucket()];
+    }
+
+    Deadline topDeadline() const
+    {
+        const size_t bucket = earliestBucket();
+        if(bucket == kDueBucket)
+        {
+            return mNodes[mBuckets[bucket]].deadline;
+        }
+        const int level = static_cast<int>(bucket / kBucketsPerLevel);
+        return eventTick(level, bucket % kBucketsPerLevel) * Resolution;
+    }
+
+    template<typename Output>
+    void popExpired(Deadline now, Output&& output)
+    {
+        const Deadline target = now / Resolution;
+        popDue(output);
+        while(mSize > 0)
+        {
+            const int level = lowestOccupiedLevel();
+            if(level < 0)
+            {
+                break;
+            }
+            const size_t index = static_cast<size_t>(Detail::countTrailingZeros(mOccupied[level]));
+            const Deadline tick = eventTick(level, index);
+            if(tick > target)
+            {
+                break;
+            }
+
+            // Advance to the bucket's start; its entries are either due or move down a level
+            mCurrentTick = tick;
+            const size_t bucket = level * kBucketsPerLevel + index;
+            Slot slot = mBuckets[bucket];
+            mBuckets[bucket] = kNone;
+            mOccupied[level] &= ~(uint64_t(1) << index);
+            while(slot != kNone)
+            {
+                const Slot next = mNodes[slot].next;
+                file(slot);
+                slot = next;
+            }
+            popDue(output);
+        }
+        if(target > mCurrentTick)
+        {
+            mCurrentTick = target;
+        }
+    }
+
+    template<typename Visitor>
+    void forEach(Visitor&& visitor) const
+    {
+        for(size_t bucket = 0; bucket < kBucketCount; ++bucket)
+        {
+            for(Slot slot = mBuckets[bucket]; slot != kNone; slot = mNodes[slot].next)
+            {
+                visitor(slot, mNodes[slot].deadline);
+            }
+        }
+    }
+
+    void clear()
+    {
+        mBuckets.fill(kNone);
+        mOccupied.fill(0);
+        mSize = 0;
+    }
+
+private:
+    static constexpr int kLevelBits = 6;
+    static constexpr size_t kBucketsPerLevel = size_t(1) << kLevelBits;
+    static constexpr int kLevels = 11;
+    // Entries whose tick has already been reached wait in an extra bucket after the wheel
+    static constexpr size_t kDueBucket = kLevels * kBucketsPerLevel;
+    static constexpr size_t kBucketCount = kDueBucket + 1;
+    static constexpr Slot kNone = UINT32_MAX;
+
+    struct Node
+    {
+        Deadline deadline{0};
+        Deadline tick{0};
+        Slot prev{kNone};
+        Slot next{kNone};
+        uint32_t bucket{0};
+    };
+
+    // Tick at which a bucket of a level is reached: the current tick with the level's digit
+    // replaced by the bucket index and all lower digits cleared
+    Deadline eventTick(int level, size_t index) const
+    {
+        const int shift = level * kLevelBits;
+        const uint64_t upper = (shift + kLevelBits >= 64) ? 0 : (static_cast<uint64_t>(mCurrentTick) >> (shift + kLevelBits)) << (shift + kLevelBits);
+        return static_cast<Deadline>(upper | (static_cast<uint64_t>(index) << shift));
+    }
+
+    int lowestOccupiedLevel() const
+    {
+        for(int level = 0; level < kLevels; ++level)
+        {
+            if(mOccupied[level] != 0)
+            {
+                return level;
+            }
+        }
+        return -1;
+    }
+
+    size_t earliestBucket() const
+    {
+        if(mBuckets[kDueBucket] != kNone)
+        {
+            return kDueBucket;
+        }
+        const int level = lowestOccupiedLevel();
+        return level * kBucketsPerLevel + static_cast<size_t>(Detail::countTrailingZeros(mOccupied[level]));
+    }
+
+    // Files a node into the bucket for its tick relative to the current tick
+    void file(Slot slot)
+    {
+        Node& node = mNodes[slot];
+        size_t bucket = kDueBucket;
+        if(node.tick > mCurrentTick)
+        {
+            const uint64_t difference = static_cast<uint64_t>(node.tick) ^ static_cast<uint64_t>(mCurrentTick);
+            int level = 0;
+            while(level + 1 < kLevels && (difference >> ((level + 1) * kLevelBits)) != 0)
+            {
+                ++level;
+            }
+            const size_t index = (static_cast<uint64_t>(node.tick) >> (level * kLevelBits)) & (kBucketsPerLevel - 1);
+            bucket = level * kBucketsPerLevel + index;
+            mOccupied[level] |= uint64_t(1) << index;
+        }
+
+        node.bucket = static_cast<uint32_t>(bucket);
+        node.prev = kNone;
+        node.next = mBuckets[bucket];
+        if(node.next != kNone)
+        {
+            mNodes[node.next].prev = slot;
+        }
+        mBuckets[bucket] = slot;
+    }
+
+    void unlink(Slot slot)
+    {
+        Node& node = mNodes[slot];
+        if(node.prev != kNone)
+        {
+            mNodes[node.prev].next = node.next;
+        }
+        else
+        {
+            mBuckets[node.bucket] = node.next;
+            if(node.next == kNone && node.bucket != kDueBucket)
+            {
+                mOccupied[node.bucket / kBucketsPerLevel] &= ~(uint64_t(1) << (node.bucket % kBucketsPerLevel));
+            }
+        }
+        if(node.next != kNone)
+        {
+            mNodes[node.next].prev = node.prev;
+        }
+    }
+
+    template<typename Output>
+    void popDue(Output& output)
+    {
+        Slot slot = mBuckets[kDueBucket];
+        mBuckets[kDueBucket] = kNone;
+        while(slot != kNone)
+        {
+            const Slot next = mNodes[slot].next;
+            --mSize;
+            output(slot, mNodes[slot].deadline);
+            slot = next;
+        }
+    }
+
+    std::pmr::vector<Node> mNodes;
+    std::array<Slot, kBucketCount> mBuckets;
+    std::array<uint64_t, kLevels> mOccupied;
+    Deadline mCurrentTick{0};
+    size_t mSize{0};
+};
+
+// Radix heap for timer populations whose deadlines span many orders of magnitude (milliseconds to
+// days), where no single wheel geometry fits. Deadlines are filed into 65 buckets by the highest bit
+// in which they differ from the last deadline reached; popping redistributes the earliest bucket into
+// lower ones, so each entry moves at most 64 times in its lifetime and push, erase and pop are
+// amortized O(1) regardless of the spread, with no geometry to tune. Buckets are arrays of (key,
+// slot), so redistributing streams through memory. Deadlines are exact; topDeadline() is the
+// minimum of the earliest bucket, or a lower bound of it after its minimum was erased, in which case
+// top() is an arbitrary entry of that bucket. Deadlines earlier than the last one reached are due,
+// and are filed as reached; popExpired() sorts them among the reached entries by deadline.
+class RadixHeapQueue
+{
+public:
+    static constexpr size_t kCapacity = SIZE_MAX;
+    static constexpr size_t kNodeBytes = 0;
+
+    explicit RadixHeapQueue(std::pmr::memory_resource* resource) :
+        mNodes(resource),
+        mBuckets(kBucketCount, resource), // the buckets allocate from the resource too
+        mRedistributed(resource)
+    {
+        mMinimumKeys.fill(kNoKey);
+        mMinimumSlots.fill(kNone);
+    }
+
+    void reserve(size_t capacity)
+    {
+        mNodes.reserve(capacity);
+    }
+
+    bool push(Deadline deadline, Slot slot)
+    {
+        if(slot >= mNodes.size())
+        {
+            mNodes.resize(slot + 1);
+        }
+        mNodes[slot].deadline = deadline;
+        const uint64_t key = toKey(deadline);
+        file(Entry{std::max(key, mLast), slot});
+        if(key < mLast)
+        {
+            // Overdue: filed as reached, but the minimum of the reached entries is its own deadline
+            mReachedUnsorted = true;
+            if(key < mMinimumKeys[0])
+            {
+                mMinimumKeys[0] = key;
+                mMinimumSlots[0] = slot;
+            }
+        }
+        ++mSize;
+        return true;
+    }
+
+    bool pushBack(Deadline deadline, Slot slot)
+    {
+        return push(deadline, slot);
+    }
+
+    void erase(Slot slot)
+    {
+        const Node& node = mNodes[slot];
+        std::pmr::vector<Entry>& bucket = mBuckets[node.bucket];
+        if(mMinimumSlots[node.bucket] == slot)
+        {
+            mMinimumSlots[node.bucket] = kNone; // the minimum key stays as a lower bound
+        }
+
+        // Move the bucket's last entry into the hole
+        const Entry last = bucket.back();
+        bucket[node.index] = last;
+        mNodes[last.slot].index = node.index;
+        bucket.pop_back();
+        if(bucket.empty())
+        {
+            emptyBucket(node.bucket);
+        }
+        --mSize;
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    Slot top() const
+    {
+        const size_t bucket = earliestBucket();
+        return (mMinimumSlots[bucket] != kNone) ? mMinimumSlots[bucket] : mBuckets[bucket].front().slot;
+    }
+
+    Deadline topDeadline() const
+    {
+        return fromKey(mMinimumKeys[earliestBucket()]);
+    }
+
+    template<typename Output>
+    void popExpired(Deadline now, Output&& output)
+    {
+        const uint64_t nowKey = toKey(now);
+        while(mSize > 0)
+        {
+            popReached(output);
+            if(mOccupied == 0 || mMinimumKeys[earliestBucket()] > nowKey)
+            {
+                break;
+            }
+
+            // Redistribute the earliest bucket relative to its true minimum (or to now, if none of
+            // it is due); every entry lands in a lower bucket
+            const size_t bucket = earliestBucket();
+            mRedistributed.swap(mBuckets[bucket]);
+            emptyBucket(bucket);
+            uint64_t minimum = kNoKey;
+            for(const Entry& entry : mRedistributed)
+            {
+                minimum = std::min(minimum, entry.key);
+            }
+            mLast = std::min(minimum, nowKey);
+            for(const Entry& entry : mRedistributed)
+            {
+                file(entry);
+            }
+            mRedistributed.clear();
+        }
+    }
+
+    template<typename Visitor>
+    void forEach(Visitor&& visitor) const
+    {
+        for(const auto& bucket : mBuckets)
+        {
+            for(const Entry& entry : bucket)
+            {
+                visitor(entry.slot, mNodes[entry.slot].deadline);
+            }
+        }
+    }
+
+    void clear()
+    {
+        for(size_t bucket = 0; bucket < kBucketCount; ++bucket)
+        {
+            emptyBucket(bucket);
+        }
+        mLast = 0;
+        mSize = 0;
+    }
+
+private:
+    // Bucket 0 holds the entries at the last deadline reached; bucket b > 0 those differing from it
+    // first in bit b - 1
+    static constexpr size_t kBucketCount = 65;
+    static constexpr Slot kNone = UINT32_MAX;
+    static constexpr uint64_t kNoKey = UINT64_MAX;
+
+    struct Entry
+    {
+        uint64_t key;
+        Slot slot;
+    };
+
+    struct Node
+    {
+        Deadline deadline{0};
+        uint32_t bucket{0};
+        uint32_t index{0};
+    };
+
+    // Keys are deadlines mapped to unsigned values of the same order
+    static uint64_t toKey(Deadline deadline)
+    {
+        return static_cast<uint64_t>(deadline) ^ (uint64_t(1) << 63);
+    }
+
+    static Deadline fromKey(uint64_t key)
+    {
+        return static_cast<Deadline>(key ^ (uint64_t(1) << 63));
+    }
+
+    size_t earliestBucket() const
+    {
+        if(!mBuckets[0].empty() || mOccupied == 0)
+        {
+            return 0;
+        }
+        return static_cast<size_t>(Detail::countTrailingZeros(mOccupied)) + 1;
+    }
+
+    // Clears a bucket, keeping its capacity
+    void emptyBucket(size_t bucket)
+    {
+        mBuckets[bucket].clear();
+        mMinimumKeys[bucket] = kNoKey;
+        mMinimumSlots[bucket] = kNone;
+        if(bucket > 0)
+        {
+            mOccupied &= ~(uint64_t(1) << (bucket - 1));
+        }
+        else
+        {
+            mReachedUnsorted = false;
+        }
+    }
+
+    // Appends an entry to the bucket for its key relative to the last deadline reached
+    void file(const Entry& entry)
+    {
+        const uint64_t difference = entry.key ^ mLast;
+        const size_t bucket = (difference == 0) ? 0 : static_cast<size_t>(64 - Detail::countLeadingZeros(difference));
+        if(bucket > 0)
+        {
+            mOccupied |= uint64_t(1) << (bucket - 1);
+        }
+        if(entry.key < mMinimumKeys[bucket])
+        {
+            mMinimumKeys[bucket] = entry.key;
+            mMinimumSlots[bucket] = entry.slot;
+        }
+
+        Node& node = mNodes[entry.slot];
+        node.bucket = static_cast<uint32_t>(bucket);
+        node.index = static_cast<uint32_t>(mBuckets[bucket].size());
+        mBuckets[bucket].push_back(entry);
+    }
+
+    // Outputs the entries at the last deadline reached (bucket 0), with any overdue ones first
+    template<typename Output>
+    void popReached(Output& output)
+    {
+        std::pmr::vector<Entry>& reached = mBuckets[0];
+        if(mReachedUnsorted)
+        {
+            std::sort(reached.begin(), reached.end(), [this](const Entry& a, const Entry& b)
+            {
+                return mNodes[a.slot].deadline < mNodes[b.slot].deadline;
+            });
+        }
+        for(const Entry& entry : reached)
+        {
+            output(entry.slot, mNodes[entry.slot].deadline);
+        }
+        mSize -= reached.size();
+        emptyBucket(0);
+    }
+
+    std::pmr::vector<Node> mNodes;
+    std::pmr::vector<std::pmr::vector<Entry>> mBuckets;
+    // Smallest key filed into each bucket, and its slot (kNone once erased)
+    std::array<uint64_t, kBucketCount> mMinimumKeys;
+    std::array<Slot, kBucketCount> mMinimumSlots;
+    // Bit b - 1 set if bucket b > 0 has entries
+    uint64_t mOccupied{0};
+    uint64_t mLast{0};
+    size_t mSize{0};
+    // Whether bucket 0 holds overdue entries, which are out of deadline order
+    bool mReachedUnsorted{false};
+    // Scratch array a bucket is swapped into while it is redistributed
+    std::pmr::vector<Entry> mRedistributed;
+};
+
+// Two tiers for populations of long timeouts that are mostly cancelled before they expire: a precise
+// Near queue for the deadlines before the horizon, and coarse far buckets (unordered intrusive lists,
+// O(1) push and erase) for the deadlines after it. A far bucket spans 2^BucketBits ticks (about
+// 1.07 s of a nanosecond clock), and a ring of Buckets of them covers the time after the horizon
+// (about 18 minutes); later deadlines wait in an overflow list that is redistributed about once per
+// half ring. As time reaches a bucket, its entries migrate into the near queue, so only the timers
+// about to fire pay for ordering. topDeadline() is the start of the earliest far bucket while the
+// near queue is empty.
+template<typename Near = MultimapQueue, int BucketBits = 30, size_t Buckets = 1024>
+class TieredQueue
+{
+    static_assert(Buckets >= 64 && (Buckets & (Buckets - 1)) == 0, "Buckets must be a power of two, at least 64");
+
+public:
+    static constexpr size_t kCapacity = std::min<size_t>(Near::kCapacity, UINT32_MAX - 1);
+    static constexpr size_t kNodeBytes = Near::kNodeBytes;
+
+    explicit TieredQueue(std::pmr::memory_resource* resource) :
+        mNear(resource),
+        mNodes(resource)
+    {
+        mHeads.fill(kNone);
+        mOccupied.fill(0);
+    }
+
+    void reserve(size_t capacity)
+    {
+        mNear.reserve(capacity);
+        mNodes.reserve(capacity);
+    }
+
+    bool push(Deadline deadline, Slot slot)
+    {
+        if(slot >= mNodes.size())
+        {
+            mNodes.resize(slot + 1);
+        }
+        mNodes[slot].deadline = deadline;
+        const int64_t bucket = bucketOf(deadline);
+        if(bucket < mHorizon)
+        {
+            if(!mNear.push(deadline, slot))
+            {
+                return false;
+            }
+            mNodes[slot].list = kNearList;
+            return true;
+        }
+        file(slot, bucket);
+        ++mFarSize;
+        return true;
+    }
+
+    bool pushBack(Deadline deadline, Slot slot)
+    {
+        if(bucketOf(deadline) < mHorizon)
+        {
+            if(slot >= mNodes.size())
+            {
+                mNodes.resize(slot + 1);
+            }
+            if(!mNear.pushBack(deadline, slot))
+            {
+                return false;
+            }
+            mNodes[slot].deadline = deadline;
+            mNodes[slot].list = kNearList;
+            return true;
+        }
+        return push(deadline, slot);
+    }
+
+    void erase(Slot slot)
+    {
+        if(mNodes[slot].list == kNearList)
+        {
+            mNear.erase(slot);
+            return;
+        }
+        unlink(slot);
+        --mFarSize;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t size() const
+    {
+        return mNear.size() + mFarSize;
+    }
+
+    Slot top() const
+    {
+        if(!mNear.empty())
+        {
+            return mNear.top();
+        }
+        return mHeads[earliestFarList()];
+    }
+
+    Deadline topDeadline() const
+    {
+        if(!mNear.empty())
+        {
+            return mNear.topDeadline();
+        }
+        const size_t list = earliestFarList();
+        return bucketStart((list == kOverflowList) ? mOverflowMinimum : ringBucket(list));
+    }
+
+    template<typename Output>
+    void popExpired(Deadline now, Output&& output)
+    {
+        const int64_t bucket = bucketOf(now);
+        if(bucket >= mHorizon)
+        {
+            advanceHorizon(bucket + 1);
+        }
+        mNear.popExpired(now, output);
+    }
+
+    template<typename Visitor>
+    void forEach(Visitor&& visitor) const
+    {
+        mNear.forEach(visitor);
+        for(size_t list = 0; list <= kOverflowList; ++list)
+        {
+            for(Slot slot = mHeads[list]; slot != kNone; slot = mNodes[slot].next)
+            {
+                visitor(slot, mNodes[slot].deadline);
+            }
+        }
+    }
+
+    void clear()
+    {
+        mNear.clear();
+        mHeads.fill(kNone);
+        mOccupied.fill(0);
+        mFarSize = 0;
+        mOverflowSize = 0;
+        mOverflowMinimum = INT64_MAX;
+    }
+
+private:
+    static constexpr Slot kNone = UINT32_MAX;
+    static constexpr size_t kRingMask = Buckets - 1;
+    static constexpr size_t kWords = Buckets / 64;
+    // List indices beyond the ring
+    static constexpr size_t kOverflowList = Buckets;
+    static constexpr uint32_t kNearList = Buckets + 1;
+
+    struct Node
+    {
+        Deadline deadline{0};
+        Slot prev{kNone};
+        Slot next{kNone};
+        uint32_t list{kNearList};
+    };
+
+    static int64_t bucketOf(Deadline deadline)
+    {
+        return deadline >> BucketBits;
+    }
+
+    static Deadline bucketStart(int64_t bucket)
+    {
+        return bucket * (Deadline(1) << BucketBits);
+    }
+
+    // Whether a far bucket lies within the ring
+    bool inRing(int64_t bucket) const
+    {
+        return static_cast<uint64_t>(bucket) - static_cast<uint64_t>(mHorizon) < Buckets;
+    }
+
+    // The bucket a ring list currently holds
+    int64_t ringBucket(size_t list) const
+    {
+        return static_cast<int64_t>(static_cast<uint64_t>(mHorizon) + ((list - static_cast<uint64_t>(mHorizon)) & kRingMask));
+    }
+
+    void file(Slot slot, int64_t bucket)
+    {
+        size_t list = kOverflowList;
+        if(inRing(bucket))
+        {
+            list = static_cast<size_t>(bucket) & kRingMask;
+            mOccupied[list / 64] |= uint64_t(1) << (list % 64);
+        }
+        else
+        {
+            ++mOverflowSize;
+            mOverflowMinimum = std::min(mOverflowMinimum, bucket);
+        }
+        Node& node = mNodes[slot];
+        node.list = static_cast<uint32_t>(list);
+        node.prev = kNone;
+        node.next = mHeads[list];
+        if(node.next != kNone)
+        {
+            mNodes[node.next].prev = slot;
+        }
+        mHeads[list] = slot;
+    }
+
+    void unlink(Slot slot)
+    {
+        Node& node = mNodes[slot];
+        if(node.prev != kNone)
+        {
+            mNodes[node.prev].next = node.next;
+        }
+        else
+        {
+            mHeads[node.list] = node.next;
+            if(node.next == kNone && node.list != kOverflowList)
+            {
+                mOccupied[node.list / 64] &= ~(uint64_t(1) << (node.list % 64));
+            }
+        }
+        if(node.next != kNone)
+        {
+            mNodes[node.next].prev = node.prev;
+        }
+        if(node.list == kOverflowList)
+        {
+            --mOverflowSize; // the minimum stays a lower bound
+        }
+    }
+
+    // The ring list of the earliest occupied bucket, or the overflow list if that may be earlier;
+    // there must be far entries
+    size_t earliestFarList() const
+    {
+        const size_t start = static_cast<size_t>(mHorizon) & kRingMask;
+        size_t word = start / 64;
+        uint64_t bits = mOccupied[word] & (~uint64_t(0) << (start % 64));
+        for(size_t i = 0; i <= kWords; ++i)
+        {
+            if(bits != 0)
+            {
+                const size_t list = word * 64 + static_cast<size_t>(Detail::countTrailingZeros(bits));
+                return (mOverflowSize > 0 && mOverflowMinimum < ringBucket(list)) ? kOverflowList : list;
+            }
+            word = (word + 1) % kWords;
+            bits = mOccupied[word];
+        }
+        return kOverflowList;
+    }
+
+    // Migrates the far buckets before the new horizon into the near queue
+    void advanceHorizon(int64_t horizon)
+    {
+        if(mFarSize > mOverflowSize)
+        {
+            const int64_t end = inRing(horizon) ? horizon : static_cast<int64_t>(static_cast<uint64_t>(mHorizon) + Buckets);
+            for(int64_t bucket = mHorizon; bucket != end; ++bucket)
+            {
+                const size_t list = static_cast<size_t>(bucket) & kRingMask;
+                Slot slot = mHeads[list];
+                while(slot != kNone)
+                {
+                    const Slot next = mNodes[slot].next;
+                    mNear.push(mNodes[slot].deadline, slot);
+                    mNodes[slot].list = kNearList;
+                    --mFarSize;
+                    slot = next;
+                }
+                mHeads[list] = kNone;
+                mOccupied[list / 64] &= ~(uint64_t(1) << (list % 64));
+            }
+        }
+        mHorizon = horizon;
+
+        // Refill once overflow entries may come within half a ring
+        if(mOverflowSize > 0 && mOverflowMinimum < mHorizon + static_cast<int64_t>(Buckets / 2))
+        {
+            Slot slot = mHeads[kOverflowList];
+            mHeads[kOverflowList] = kNone;
+            mOverflowSize = 0;
+            mOverflowMinimum = INT64_MAX;
+            while(slot != kNone)
+            {
+                const Slot next = mNodes[slot].next;
+                const int64_t bucket = bucketOf(mNodes[slot].deadline);
+                if(bucket < mHorizon)
+                {
+                    mNear.push(mNodes[slot].deadline, slot);
+                    mNodes[slot].list = kNearList;
+                    --mFarSize;
+                }
+                else
+                {
+                    file(slot, bucket);
+                }
+                slot = next;
+            }
+        }
+    }
+
+    Near mNear;
+    std::pmr::vector<Node> mNodes;
+    // Ring lists followed by the overflow list
+    std::array<Slot, Buckets + 1> mHeads;
+    std::array<uint64_t, kWords> mOccupied;
+    // Deadlines in buckets before the horizon are in the near queue
+    int64_t mHorizon{INT64_MIN};
+    size_t mFarSize{0};
+    size_t mOverflowSize{0};
+    int64_t mOverflowMinimum{INT64_MAX};
+};
+
+// Deadline scanning kernels of SimdQueue: scalar, AVX2 and AVX-512, picked once at run time by what the
+// CPU supports.
+namespace SimdKernels
+{
+
+// Index of the (first) earliest of count > 0 deadlines
+inline size_t minimumScalar(const Deadline* deadlines, size_t count)
+{
+    size_t index = 0;
+    for(size_t i = 1; i < count; ++i)
+    {
+        if(deadlines[i] < deadlines[index])
+        {
+            index = i;
+        }
+    }
+    return index;
+}
+
+// In one pass, writes the indices of the deadlines due at now and finds the (first) earliest of the
+// others; returns the number due, and sets next to the earliest other's index (count if none)
+inline size_t expiredScalar(const Deadline* deadlines, size_t count, Deadline now, uint32_t* indices, size_t& next)
+{
+    size_t expired = 0;
+    Deadline earliest = INT64_MAX;
+    next = count;
+    for(size_t i = 0; i < count; ++i)
+    {
+        const Deadline deadline = deadlines[i];
+        indices[expired] = static_cast<uint32_t>(i);
+        expired += (deadline <= now) ? 1 : 0;
+        if(deadline > now && deadline < earliest)
+        {
+            earliest = deadline;
+            next = i;
+        }
+    }
+    return expired;
+}
+
+#if defined(TIMER_QUEUES_X86_KERNELS)
+
+// Lanes' (deadline, index) pairs reduced to the earliest deadline's lowest index; count if all are INT64_MAX
+inline size_t reduceLanes(const Deadline* values, const int64_t* positions, size_t lanes, Deadline& earliest, size_t count)
+{
+    size_t index = count;
+    earliest = INT64_MAX;
+    for(size_t lane = 0; lane < lanes; ++lane)
+    {
+        if(values[lane] < earliest || (values[lane] == earliest && values[lane] != INT64_MAX && static_cast<size_t>(positions[lane]) < index))
+        {
+            earliest = values[lane];
+            index = static_cast<size_t>(positions[lane]);
+        }
+    }
+    return index;
+}
+
+__attribute__((target("avx2"))) inline size_t minimumAvx2(const Deadline* deadlines, size_t count)
+{
+    if(count < 8)
+    {
+        return minimumScalar(deadlines, count);
+    }
+    const size_t vectorCount = count & ~size_t(3);
+    __m256i minimum = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(deadlines));
+    __m256i minimumPositions = _mm256_set_epi64x(3, 2, 1, 0);
+    __m256i positions = minimumPositions;
+    const __m256i step = _mm256_set1_epi64x(4);
+    for(size_t i = 4; i < vectorCount; i += 4)
+    {
+        positions = _mm256_add_epi64(positions, step);
+        const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(deadlines + i));
+        const __m256i earlier = _mm256_cmpgt_epi64(minimum, values);
+        minimum = _mm256_blendv_epi8(minimum, values, earlier);
+        minimumPositions = _mm256_blendv_epi8(minimumPositions, positions, earlier);
+    }
+    alignas(32) Deadline values[4];
+    alignas(32) int64_t lanePositions[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(values), minimum);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanePositions), minimumPositions);
+    Deadline earliest;
+    size_t index = reduceLanes(values, lanePositions, 4, earliest, count);
+    for(size_t i = vectorCount; i < count; ++i)
+    {
+        if(deadlines[i] < earliest || index == count)
+        {
+            earliest = deadlines[i];
+            index = i;
+        }
+    }
+    return (index == count) ? 0 : index;
+}
+
+__attribute__((target("avx2"))) inline size_t expiredAvx2(const Deadline* deadlines, size_t count, Deadline now, uint32_t* indices, size_t& next)
+{
+    const size_t vectorCount = count & ~size_t(3);
+    const __m256i limit = _mm256_set1_epi64x(now);
+    const __m256i none = _mm256_set1_epi64x(INT64_MAX);
+    const __m256i step = _mm256_set1_epi64x(4);
+    __m256i positions = _mm256_set_epi64x(3, 2, 1, 0);
+    __m256i minimum = none;
+    __m256i minimumPositions = positions;
+    size_t expired = 0;
+    for(size_t i = 0; i < vectorCount; i += 4)
+    {
+        const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(deadlines + i));
+        const __m256i pending = _mm256_cmpgt_epi64(values, limit);
+        unsigned due = ~static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(pending))) & 0xfu;
+        while(due != 0)
+        {
+            indices[expired++] = static_cast<uint32_t>(i + static_cast<size_t>(Detail::countTrailingZeros(due)));
+            due &= due - 1;
+        }
+        const __m256i candidates = _mm256_blendv_epi8(none, values, pending);
+        const __m256i earlier = _mm256_cmpgt_epi64(minimum, candidates);
+        minimum = _mm256_blendv_epi8(minimum, candidates, earlier);
+        minimumPositions = _mm256_blendv_epi8(minimumPositions, positions, earlier);
+        positions = _mm256_add_epi64(positions, step);
+    }
+    alignas(32) Deadline values[4];
+    alignas(32) int64_t lanePositions[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(values), minimum);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanePositions), minimumPositions);
+    Deadline earliest;
+    next = reduceLanes(values, lanePositions, 4, earliest, count);
+    for(size_t i = vectorCount; i < count; ++i)
+    {
+        indices[expired] = static_cast<uint32_t>(i);
+        expired += (deadlines[i] <= now) ? 1 : 0;
+        if(deadlines[i] > now && deadlines[i] < earliest)
+        {
+            earliest = deadlines[i];
+            next = i;
+        }
+    }
+    return expired;
+}
+
+__attribute__((target("avx512f"))) inline size_t minimumAvx512(const Deadline* deadlines, size_t count)
+{
+    if(count < 16)
+    {
+        return minimumScalar(deadlines, count);
+    }
+    const size_t vectorCount = count & ~size_t(7);
+    const __m512i step = _mm512_set1_epi64(8);
+    __m512i minimum = _mm512_loadu_si512(deadlines);
+    __m512i minimumPositions = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    __m512i positions = minimumPositions;
+    for(size_t i = 8; i < vectorCount; i += 8)
+    {
+        positions = _mm512_add_epi64(positions, step);
+        const __m512i values = _mm512_loadu_si512(deadlines + i);
+        const __mmask8 earlier = _mm512_cmpgt_epi64_mask(minimum, values);
+        minimum = _mm512_mask_blend_epi64(earlier, minimum, values);
+        minimumPositions = _mm512_mask_blend_epi64(earlier, minimumPositions, positions);
+    }
+    alignas(64) Deadline values[8];
+    alignas(64) int64_t lanePositions[8];
+    _mm512_store_si512(values, minimum);
+    _mm512_store_si512(lanePositions, minimumPositions);
+    Deadline earliest;
+    size_t index = reduceLanes(values, lanePositions, 8, earliest, count);
+    for(size_t i = vectorCount; i < count; ++i)
+    {
+        if(deadlines[i] < earliest || index == count)
+        {
+            earliest = deadlines[i];
+            index = i;
+        }
+    }
+    return (index == count) ? 0 : index;
+}
+
+__attribute__((target("avx512f"))) inline size_t expiredAvx512(const Deadline* deadlines, size_t count, Deadline now, uint32_t* indices, size_t& next)
+{
+    const size_t vectorCount = count & ~size_t(7);
+    const __m512i limit = _mm512_set1_epi64(now);
+    const __m512i none = _mm512_set1_epi64(INT64_MAX);
+    const __m512i step = _mm512_set1_epi64(8);
+    __m512i positions = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    __m512i minimum = none;
+    __m512i minimumPositions = positions;
+    size_t expired = 0;
+    for(size_t i = 0; i < vectorCount; i += 8)
+    {
+        const __m512i values = _mm512_loadu_si512(deadlines + i);
+        const __mmask8 due = _mm512_cmple_epi64_mask(values, limit);
+        if(due != 0)
+        {
+            // Compress the due lanes' indices into the output
+            const int dueCount = __builtin_popcount(due);
+            _mm512_mask_cvtepi64_storeu_epi32(indices + expired, static_cast<__mmask8>((1u << dueCount) - 1), _mm512_maskz_compress_epi64(due, positions));
+            expired += static_cast<size_t>(dueCount);
+        }
+        const __m512i candidates = _mm512_mask_blend_epi64(due, values, none);
+        const __mmask8 earlier = _mm512_cmpgt_epi64_mask(minimum, candidates);
+        minimum = _mm512_mask_blend_epi64(earlier, minimum, candidates);
+        minimumPositions = _mm512_mask_blend_epi64(earlier, minimumPositions, positions);
+        positions = _mm512_add_epi64(positions, step);
+    }
+    alignas(64) Deadline values[8];
+    alignas(64) int64_t lanePositions[8];
+    _mm512_store_si512(values, minimum);
+    _mm512_store_si512(lanePositions, minimumPositions);
+    Deadline earliest;
+    next = reduceLanes(values, lanePositions, 8, earliest, count);
+    for(size_t i = vectorCount; i < count; ++i)
+    {
+        indices[expired] = static_cast<uint32_t>(i);
+        expired += (deadlines[i] <= now) ? 1 : 0;
+        if(deadlines[i] > now && deadlines[i] < earliest)
+        {
+            earliest = deadlines[i];
+            next = i;
+        }
+    }
+    return expired;
+}
+
+#endif
+
+struct Kernels
+{
+    size_t (*minimum)(const Deadline* deadlines, size_t count);
+    size_t (*expired)(const Deadline* deadlines, size_t count, Deadline now, uint32_t* indices, size_t& next);
+    const char* name;
+};
+
+inline Kernels selectKernels()
+{
+#if defined(TIMER_QUEUES_X86_KERNELS)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+    {
+        return Kernels{&minimumAvx512, &expiredAvx512, "avx512"};
+    }
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return Kernels{&minimumAvx2, &expiredAvx2, "avx2"};
+    }
+#endif
+    return Kernels{&minimumScalar, &expiredScalar, "scalar"};
+}
+
+// The kernels for this CPU
+inline const Kernels& kernels()
+{
+    static const Kernels selected = selectKernels();
+    return selected;
+}
+
+} // namespace SimdKernels
+
+// Unordered flat arrays for bounded timer counts (up to 64k), with the deadlines in a contiguous array
+// of their own: push and erase are O(1) (erase moves the last entry into the gap), and the earliest
+// deadline and the due entries are found by vectorized scans (see SimdKernels). The earliest entry
+// is cached; the scan for the due entries finds the next one in the same pass, so only erasing the
+// earliest entry costs a rescan. Without dynamic allocation, like
+// FixedHeapQueue; the scheduler never hands out slots beyond Capacity.
+template<size_t Capacity>
+class SimdQueue
+{
+    static_assert(Capacity <= 65536, "SimdQueue is meant for up to 64k timers");
+
+public:
+    static constexpr size_t kCapacity = Capacity;
+    static constexpr size_t kNodeBytes = 0;
+
+    explicit SimdQueue(std::pmr::memory_resource*) :
+        mKernels(SimdKernels::kernels())
+    {
+    }
+
+    void reserve(size_t)
+    {
+    }
+
+    bool push(Deadline deadline, Slot slot)
+    {
+        if(mSize == Capacity)
+        {
+            return false;
+        }
+        if(mSize == 0 || (mTopValid && deadline < mDeadlines[mPositions[mTopSlot]]))
+        {
+            mTopSlot = slot;
+            mTopValid = true;
+        }
+        mDeadlines[mSize] = deadline;
+        mSlots[mSize] = slot;
+        mPositions[slot] = static_cast<uint32_t>(mSize);
+        ++mSize;
+        return true;
+    }
+
+    bool pushBack(Deadline deadline, Slot slot)
+    {
+        return push(deadline, slot);
+    }
+
+    void erase(Slot slot)
+    {
+        removeAt(mPositions[slot]);
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    Slot top() const
+    {
+        return mSlots[topIndex()];
+    }
+
+    Deadline topDeadline() const
+    {
+        return mDeadlines[topIndex()];
+    }
+
+    template<typename Output>
+    void popExpired(Deadline now, Output&& output)
+    {
+        if(mSize == 0 || topDeadline() > now)
+        {
+            return;
+        }
+
+        size_t next = mSize;
+        const size_t expired = mKernels.expired(mDeadlines.data(), mSize, now, mExpired.data(), next);
+        std::sort(mExpired.begin(), mExpired.begin() + expired, [this](uint32_t left, uint32_t right)
+        {
+            return mDeadlines[left] < mDeadlines[right];
+        });
+        // Output first, then remove (removal moves entries, so indices are turned into slots)
+        for(size_t i = 0; i < expired; ++i)
+        {
+            output(mSlots[mExpired[i]], mDeadlines[mExpired[i]]);
+            mExpired[i] = mSlots[mExpired[i]];
+        }
+        // The same scan found the earliest remaining entry, which stays the top across the removals
+        mTopValid = (next != mSize);
+        if(mTopValid)
+        {
+            mTopSlot = mSlots[next];
+        }
+        for(size_t i = 0; i < expired; ++i)
+        {
+            removeAt(mPositions[mExpired[i]]);
+        }
+    }
+
+    template<typename Visitor>
+    void forEach(Visitor&& visitor) const
+    {
+        for(size_t i = 0; i < mSize; ++i)
+        {
+            visitor(mSlots[i], mDeadlines[i]);
+        }
+    }
+
+    void clear()
+    {
+        mSize = 0;
+        mTopValid = false;
+    }
+
+private:
+    size_t topIndex() const
+    {
+        if(!mTopValid)
+        {
+            mTopSlot = mSlots[mKernels.minimum(mDeadlines.data(), mSize)];
+            mTopValid = true;
+        }
+        return mPositions[mTopSlot];
+    }
+
+    void removeAt(size_t index)
+    {
+        --mSize;
+        if(mTopValid && mSlots[index] == mTopSlot)
+        {
+            mTopValid = false;
+        }
+        if(index != mSize)
+        {
+            mDeadlines[index] = mDeadlines[mSize];
+            mSlots[index] = mSlots[mSize];
+            mPositions[mSlots[index]] = static_cast<uint32_t>(index);
+        }
+    }
+
+    const SimdKernels::Kernels mKernels;
+    alignas(64) std::array<Deadline, Capacity> mDeadlines;
+    std::array<Slot, Capacity> mSlots;
+    std::array<uint32_t, Capacity> mPositions;
+    // Scratch indices (then slots) of the due entries
+    std::array<uint32_t, Capacity> mExpired;
+    size_t mSize{0};
+    // Slot of the earliest entry (slots, unlike indices, survive removals)
+    mutable Slot mTopSlot{0};
+    mutable bool mTopValid{false};
+};
+
+} // namespace TimerQueues
@@ -22,310 +22,161 @@
  * THE SOFTWARE.
  */
 #include "TimerScheduler.hpp"
+#include "BasicTimerScheduler.hpp"
+#include "TimerTrace.hpp"
 
 #include <chrono>
-#include <functional>
-#include <thread>
-#include <condition_variable>
-#include <map>
-#include <unordered_map>
-#include <vector>
+#include <mutex>
+#include <utility>
 
 
-class TimerSchedulerImpl
-{
-public:
-    TimerSchedulerImpl() = delete;
-    TimerSchedulerImpl(const TimerSchedulerImpl&) = delete;
-    TimerSchedulerImpl& operator=(const TimerSchedulerImpl &) = delete;
-    TimerSchedulerImpl(TimerSchedulerImpl &&) = delete;
-    TimerSchedulerImpl & operator=(TimerSchedulerImpl &&) = delete;
-
-    static inline void reserve(size_t anticipatedNumberOfTimers)
-    {
-        std::lock_guard<std::mutex> lock(mMutex);
-        if(mState == State::Off)
-        {
-            mTimerHandleToTimeoutTimeMap.reserve(anticipatedNumberOfTimers);
-        }
-    }
-
-    static inline void run()
-    {
-        std::lock_guard<std::mutex> lock(mMutex);
-        if(mState == State::Off)
-        {
-            mThread = std::thread(timerThreadLoop);
-            mState = State::Running;
-        }
-    }
-
-    static inline void reset()
-    {
-        std::unique_lock<std::mutex> lock(mMutex);
-        if(mState == State::Running)
-        {
-            // This method can only work from another thread
-            if(std::this_thread::get_id() != mThread.get_id())
-            {
-                // wake up the thread (will still be blocked by mutex until after the new state is set below)
-                mCondition.notify_one();
-                mState = State::Stopping; // transition to Stopping state; signals thread to stop
-                lock.unlock();
-
-                // Unlock the lock and wait for the thread to finish
-                mThread.join();
-
-                lock.lock();
-                mTimeoutTimeToTimerMap.clear();
-                mTimerHandleToTimeoutTimeMap.clear();
-                mState = State::Off; // transition to Off state
-            }
-        }
-    }
+// Result of the backoff callback that last ran on this thread (see addBackoffTimer)
+static thread_local bool tBackoffSucceeded = false;
 
-    static inline TimerScheduler::TimerHandle addTimer(const std::chrono::milliseconds& period, TimerScheduler::TimerCallback callback)
+// Invokes callbacks inline; reports the results of backoff callbacks, which are wrapped into TimerCallbacks
+struct BackoffReportingExecutor
+{
+    bool operator()(TimerScheduler::TimerCallback& callback, TimerScheduler::TimerHandle handle) const
     {
-        // Compute timeout immediately (before locking mutex)
-        TimeoutTime timeoutTime = std::chrono::steady_clock::now() + period;
-
-        bool needToWakeThread(false);
-
-        Timer timer;
-        timer.callback = callback;
-        timer.period = period;
-        timer.handle = 0;
-
-        {
-            std::lock_guard<std::mutex> lock(mMutex);
-
-            if(mState == State::Running)
-            {
-                // Find next available handle value
-                while(mTimerHandleToTimeoutTimeMap.count(mNextAvailableHandleHint) > 0)
-                {
-                    ++mNextAvailableHandleHint;
-                }
-                timer.handle = mNextAvailableHandleHint;
-                ++mNextAvailableHandleHint; // Prepare for next use
-
-                // Add timer to maps
-                mTimerHandleToTimeoutTimeMap[timer.handle] = timeoutTime;
-                auto iter = mTimeoutTimeToTimerMap.insert(TimeoutTimeToTimerMap::value_type(timeoutTime, timer));
-                if(iter == mTimeoutTimeToTimerMap.begin())
-                {
-                    needToWakeThread = true;
-                }
-            }
-        }
-
-        if(needToWakeThread)
-        {
-            // wake up thread to adjust timeout
-            mCondition.notify_one();
-        }
-
-        return timer.handle;
+        tBackoffSucceeded = false;
+        callback(handle);
+        return tBackoffSucceeded;
     }
+};
 
-    static void removeTimer(TimerScheduler::TimerHandle handle)
-    {
-        bool needToWakeThread(false);
-
-        {
-            std::lock_guard<std::mutex> lock(mMutex);
-
-            if(mState == State::Running)
-            {
-                if(mTimerHandleToTimeoutTimeMap.count(handle) > 0)
-                {
-                    // Use the reverse mapping to get the timeout time. Iterate over the equal keys
-                    // to find the one with the right handle.
-                    const TimeoutTime& timeoutTime = mTimerHandleToTimeoutTimeMap[handle];
-                    const auto range = mTimeoutTimeToTimerMap.equal_range(timeoutTime);
-                    for(auto iter = range.first; iter != range.second; iter++)
-                    {
-                        if(iter->second.handle == handle)
-                        {
-                            if(iter == mTimeoutTimeToTimerMap.begin())
-                            {
-                                needToWakeThread = true;
-                            }
-
-                            mTimeoutTimeToTimerMap.erase(iter);
-                            break;
-                        }
-                    }
-                }
-            }
-        }
-
-        if(needToWakeThread)
-        {
-            // wake up thread to adjust timeout
-            mCondition.notify_one();
-        }
-    }
+using TimerSchedulerImpl = BasicTimerScheduler<std::chrono::steady_clock, TimerQueues::MultimapQueue, std::mutex, TimerScheduler::TimerCallback, BackoffReportingExecutor, TimerTrace::RingTracer>;
 
-private:
-    static void timerThreadLoop();
-    // Returns false if thread should be stopped
-    static bool checkForTimeouts();
-    // Returns false if thread should be stopped
-    static bool waitForNextTimeout();
+// Upstream of the scheduler's storage; off until useHugePages(true)
+static TimerMemory::HugePageMemoryResource& hugePages()
+{
+    static TimerMemory::HugePageMemoryResource resource(false);
+    return resource;
+}
 
-    enum class State
-    {
-        Off,
-        Running,
-        Stopping
-    };
+// Constructed on first use, so that the scheduler can be used during static initialization
+static TimerSchedulerImpl& scheduler()
+{
+    static TimerSchedulerImpl instance(&hugePages()); // (constructed first, so destroyed last)
+    return instance;
+}
 
-    struct Timer
-    {
-        TimerScheduler::TimerHandle handle;
-        TimerScheduler::TimerCallback callback;
-        std::chrono::milliseconds period;
-    };
 
-    using TimeoutTime = std::chrono::steady_clock::time_point;
-    using TimeoutTimeToTimerMap = std::multimap<TimeoutTime, Timer>;
-    using TimerHandleToTimeoutTimeMap = std::unordered_map<TimerScheduler::TimerHandle, TimeoutTime>;
+void TimerScheduler::reserve(size_t anticipatedNumberOfTimers, bool hardCapacity)
+{
+    scheduler().reserve(anticipatedNumberOfTimers, hardCapacity);
+}
 
-    // Timer data:
-    // Multimap for TimeoutTime -> Timer object
-    static TimeoutTimeToTimerMap mTimeoutTimeToTimerMap;
-    // Hash table for reverse lookup of TimerHandle -> TimeoutTime, for timer removal
-    static TimerHandleToTimeoutTimeMap mTimerHandleToTimeoutTimeMap;
-    // Hint for next available handle value (could be in use, so must check first)
-    static TimerScheduler::TimerHandle mNextAvailableHandleHint;
+void TimerScheduler::useHugePages(bool enable)
+{
+    hugePages().setEnabled(enable);
+}
 
-    static std::condition_variable mCondition;
+TimerScheduler::HugePageStatistics TimerScheduler::hugePageStatistics()
+{
+    return hugePages().statistics();
+}
 
-    static std::mutex mMutex;
+void TimerScheduler::run()
+{
+    scheduler().run();
+}
 
-    static std::thread mThread;
+void TimerScheduler::reset()
+{
+    scheduler().reset();
+}
 
-    static State mState;
-};
+void TimerScheduler::stop(const StopOptions& options)
+{
+    scheduler().stop(options);
+}
 
-std::multimap<TimerSchedulerImpl::TimeoutTime, TimerSchedulerImpl::Timer> TimerSchedulerImpl::mTimeoutTimeToTimerMap;
-std::unordered_map<TimerScheduler::TimerHandle, TimerSchedulerImpl::TimeoutTime> TimerSchedulerImpl::mTimerHandleToTimeoutTimeMap;
-TimerScheduler::TimerHandle TimerSchedulerImpl::mNextAvailableHandleHint{1};
-std::condition_variable TimerSchedulerImpl::mCondition;
-std::mutex TimerSchedulerImpl::mMutex;
-std::thread TimerSchedulerImpl::mThread;
-TimerSchedulerImpl::State TimerSchedulerImpl::mState{TimerSchedulerImpl::State::Off};
+void TimerScheduler::pause()
+{
+    scheduler().pause();
+}
 
+void TimerScheduler::resume()
+{
+    scheduler().resume();
+}
 
-void TimerScheduler::reserve(size_t anticipatedNumberOfTimers)
+TimerScheduler::TimerHandle TimerScheduler::addTimer(const std::chrono::milliseconds& period, TimerCallback callback)
 {
-    TimerSchedulerImpl::reserve(anticipatedNumberOfTimers);
+    return scheduler().addTimer(period, std::move(callback), TimerOptions());
 }
 
-void TimerScheduler::run()
+TimerScheduler::TimerHandle TimerScheduler::addTimer(const std::chrono::milliseconds& period, TimerCallback callback, const TimerOptions& options)
 {
-    TimerSchedulerImpl::run();
+    return scheduler().addTimer(period, std::move(callback), options);
 }
 
-void TimerScheduler::reset()
+TimerScheduler::TimerHandle TimerScheduler::addBackoffTimer(const std::chrono::milliseconds& baseDelay, BackoffCallback callback, const TimerOptions& options)
 {
-    TimerSchedulerImpl::reset();
+    TimerOptions backoffOptions(options);
+    backoffOptions.mode = TimerMode::Backoff;
+    return scheduler().addTimer(baseDelay, [callback = std::move(callback)](TimerHandle handle)
+    {
+        tBackoffSucceeded = callback(handle);
+    }, backoffOptions);
 }
 
-TimerScheduler::TimerHandle TimerScheduler::addTimer(const std::chrono::milliseconds& period, TimerCallback callback)
+TimerScheduler::TimerHandle TimerScheduler::addCalendarTimer(const CronExpression& expression, TimerCallback callback, const TimerOptions& options)
 {
-    return TimerSchedulerImpl::addTimer(period, callback);
+    return scheduler().addCalendarTimer(expression, std::move(callback), options);
 }
 
 void TimerScheduler::removeTimer(TimerHandle handle)
 {
-    TimerSchedulerImpl::removeTimer(handle);
+    scheduler().removeTimer(handle);
 }
 
-
-void TimerSchedulerImpl::timerThreadLoop()
+bool TimerScheduler::rescheduleTimer(TimerHandle handle, const std::chrono::milliseconds& delay)
 {
-    while(1)
-    {
-        // If either step indicates that loop should stop, break out
-        if(!checkForTimeouts() || !waitForNextTimeout())
-        {
-            break;
-        }
-    }
+    return scheduler().rescheduleTimer(handle, delay);
 }
 
-bool TimerSchedulerImpl::checkForTimeouts()
+void TimerScheduler::setCancelMode(CancelMode mode, float compactionThreshold)
 {
-    // check for timeouts
-    std::vector<Timer> timedOutTimers;
-    {
-        std::lock_guard<std::mutex> lock(mMutex);
-
-        // If should not be running, indicate to thread loop that it is time to stop
-        if(mState != State::Running)
-        {
-            return false;
-        }
+    scheduler().setCancelMode(mode, compactionThreshold);
+}
 
-        const auto now = std::chrono::steady_clock::now(); // get time AFTER mutex has been locked
-        const auto iterFirst = mTimeoutTimeToTimerMap.begin();
-        auto iter = iterFirst;
-        for(; iter != mTimeoutTimeToTimerMap.end(); iter++)
-        {
-            if(iter->first <= now)
-            {
-                timedOutTimers.push_back(iter->second);
-            }
-            else
-            {
-                break;
-            }
-        }
-        if(timedOutTimers.size() > 0)
-        {
-            mTimeoutTimeToTimerMap.erase(iterFirst, iter);
-        }
+size_t TimerScheduler::cancelGroup(TimerGroup group)
+{
+    return scheduler().cancelGroup(group);
+}
 
-        // re-insert timed out timers, reusing their handle
-        for(const auto& timer : timedOutTimers)
-        {
-            TimeoutTime timeoutTime = now + timer.period;
-            mTimeoutTimeToTimerMap.insert(TimeoutTimeToTimerMap::value_type(timeoutTime, timer));
-            mTimerHandleToTimeoutTimeMap[timer.handle] = timeoutTime; // update the reverse mapping
-        }
-    }
+TimerScheduler::GroupStatistics TimerScheduler::groupStatistics(TimerGroup group)
+{
+    return scheduler().groupStatistics(group);
+}
 
-    // call the callbacks
-    for(const auto& timer : timedOutTimers)
-    {
-        timer.callback(timer.handle);
-    }
+void TimerScheduler::clearGroupStatistics(TimerGroup group)
+{
+    scheduler().clearGroupStatistics(group);
+}
 
-    return true;
+TimerScheduler::PriorityStatistics TimerScheduler::priorityStatistics(TimerPriority priority)
+{
+    return scheduler().priorityStatistics(priority);
 }
 
-bool TimerSchedulerImpl::waitForNextTimeout()
+TimerScheduler::SchedulerStatus TimerScheduler::status()
 {
-    std::unique_lock<std::mutex> lock(mMutex);
+    return scheduler().status();
+}
 
-    // If should not be running, indicate to thread loop that it is time to stop
-    if(mState != State::Running)
-    {
-        return false;
-    }
+bool TimerScheduler::isTimerActive(TimerHandle handle)
+{
+    return scheduler().isTimerActive(handle);
+}
 
-    if(mTimeoutTimeToTimerMap.size() > 0)
-    {
-        // wait for next timeout to happen
-        mCondition.wait_until(lock, mTimeoutTimeToTimerMap.begin()->first);
-    }
-    else
-    {
-        // If there are no timers, wait indefinitely (will wake up and reevaluate if a timer is scheduled).
-        mCondition.wait(lock);
-    }
+bool TimerScheduler::snapshot(const char* path)
+{
+    return scheduler().snapshot(path);
+}
 
-    return true;
+size_t TimerScheduler::restore(const char* path, const CallbackRegistry& registry)
+{
+    return scheduler().restore(path, registry);
 }
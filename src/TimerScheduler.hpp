@@ -23,10 +23,19 @@
  */
 #pragma once
 
+#include "TimerTypes.hpp"
+#include "TimerCalendar.hpp"
+#include "TimerMemory.hpp"
+#include "TimerSnapshot.hpp"
+
 #include <chrono>
 #include <functional>
 #include <cstdint>
+#include <cstddef>
 
+// The process-wide scheduler: a BasicTimerScheduler (see BasicTimerScheduler.hpp) with a steady clock,
+// a multimap queue, a mutex, std::function callbacks and callbacks invoked on the scheduler thread.
+// Its activity can be traced with TimerTrace::enable() and TimerTrace::flush() (see TimerTrace.hpp).
 class TimerScheduler
 {
 public:
@@ -36,23 +45,105 @@ public:
     TimerScheduler(TimerScheduler &&) = delete;
     TimerScheduler & operator=(TimerScheduler &&) = delete;
 
-    using TimerHandle = int32_t;
+    using TimerHandle = TimerTypes::TimerHandle;
     using TimerCallback = std::function<void(TimerHandle handle)>;
+    // Returns true on success, which ends a backoff timer
+    using BackoffCallback = std::function<bool(TimerHandle handle)>;
+    using TimerGroup = TimerTypes::TimerGroup;
+    using TimerMode = TimerTypes::TimerMode;
+    using TimerOptions = TimerTypes::TimerOptions;
+    using JitterMode = TimerTypes::JitterMode;
+    using CancelMode = TimerTypes::CancelMode;
+    using GroupStatistics = TimerTypes::GroupStatistics;
+    using TimerPriority = TimerTypes::TimerPriority;
+    using PriorityStatistics = TimerTypes::PriorityStatistics;
+    using SchedulerStatus = TimerTypes::SchedulerStatus<std::chrono::steady_clock::time_point>;
+    using StopOptions = TimerTypes::StopOptions;
+    using CallbackRegistry = TimerCallbackRegistry<TimerCallback>;
+    using CronExpression = TimerCalendar::CronExpression;
+    using HugePageStatistics = TimerMemory::HugePageStatistics;
 
     // Call to set allocation for timer data storage; only has an affect if not the scheduler is not running.
-    static void reserve(size_t anticipatedNumberOfTimers);
+    // Afterwards, up to anticipatedNumberOfTimers timers are handled without further heap allocation (callbacks
+    // are moved into place; only constructing the TimerCallback itself may allocate). With hardCapacity, addTimer
+    // returns 0 instead of growing beyond anticipatedNumberOfTimers.
+    static void reserve(size_t anticipatedNumberOfTimers, bool hardCapacity = false);
+
+    // Call before reserve() to back the timer storage (including the callbacks) and the queue's node pool
+    // with 2 MB huge pages, which cuts TLB misses with millions of timers; see TimerMemory.hpp. Falls back to
+    // transparent huge pages if no huge pages are reserved (vm.nr_hugepages). Storage allocated earlier stays
+    // where it is.
+    static void useHugePages(bool enable);
+
+    // How many huge pages back the scheduler's storage, to confirm that useHugePages() is effective.
+    static HugePageStatistics hugePageStatistics();
 
     // Call to start the scheduler.
     static void run();
 
     // Call to stop the scheduler. This will also remove all timers.
-    // This must be called from a thread context other than the scheduler (if this is called from
-    // within a timeout callback it will have no affect).
+    // If this is called from within a timeout callback, the scheduler stops once the callback has returned.
     static void reset();
 
+    // Stop the scheduler, optionally firing the timers due within a grace period first, or keeping the
+    // timers (paused) for a later run() and resume(); see StopOptions.
+    static void stop(const StopOptions& options);
+
+    // Stop firing timers, keeping them; after resume(), every timer is due as much later as the pause lasted.
+    static void pause();
+
+    // Continue firing timers after pause().
+    static void resume();
+
     // Add a timer
     static TimerHandle addTimer(const std::chrono::milliseconds& period, TimerCallback callback);
 
-    // Remove a timer
+    // Add a timer with options (e.g. a group)
+    static TimerHandle addTimer(const std::chrono::milliseconds& period, TimerCallback callback, const TimerOptions& options);
+
+    // Add a backoff (retry) timer: it fires after baseDelay, then after growing delays, until the callback
+    // returns true or the attempts run out (see TimerMode::Backoff; the options' mode is ignored).
+    static TimerHandle addBackoffTimer(const std::chrono::milliseconds& baseDelay, BackoffCallback callback, const TimerOptions& options = TimerOptions());
+
+    // Add a timer that fires at the wall-clock times of a calendar expression, e.g.
+    // CronExpression::parse("30 2 * * *") for 02:30 UTC daily (see TimerCalendar.hpp). Returns 0 if the
+    // expression matches no future time.
+    static TimerHandle addCalendarTimer(const CronExpression& expression, TimerCallback callback, const TimerOptions& options = TimerOptions());
+
+    // Remove a timer. A stale handle is ignored; handles are reused only after roughly 130000 further adds.
     static void removeTimer(TimerHandle handle);
+
+    // Move a timer's next deadline to delay from now, keeping its handle; also re-arms a dormant Manual
+    // timer. Returns false if the handle is stale.
+    static bool rescheduleTimer(TimerHandle handle, const std::chrono::milliseconds& delay);
+
+    // Set how removeTimer() cancels timers (default is Eager); may be changed at any time.
+    static void setCancelMode(CancelMode mode, float compactionThreshold = 0.25f);
+
+    // Remove all timers of a group in a single pass; returns the number of timers removed.
+    static size_t cancelGroup(TimerGroup group);
+
+    // Get the statistics of a group since its first timer (kept after its timers are gone).
+    static GroupStatistics groupStatistics(TimerGroup group);
+
+    // Reset the statistics of a group; drops its record if it has no timers.
+    static void clearGroupStatistics(TimerGroup group);
+
+    // Get the fired callbacks and lateness of a priority class (see TimerPriority).
+    static PriorityStatistics priorityStatistics(TimerPriority priority);
+
+    // Get whether the scheduler runs, its queued timers, next deadline and fired callbacks, without locking
+    // (for monitoring; see BasicTimerScheduler::status()).
+    static SchedulerStatus status();
+
+    // Whether a timer has not been removed (nor fired, if one-shot); without locking.
+    static bool isTimerActive(TimerHandle handle);
+
+    // Write all timers added with a callback key to a snapshot file (dormant Manual timers included, and
+    // restored dormant); returns false on failure.
+    static bool snapshot(const char* path);
+
+    // Restore a snapshot into the running scheduler (which must have no timers), keeping the timer
+    // handles; returns the number of timers restored.
+    static size_t restore(const char* path, const CallbackRegistry& registry);
 };
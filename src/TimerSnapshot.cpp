@@ -0,0 +1,123 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "TimerSnapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+bool TimerSnapshot::writeFile(const char* path, const Entry* entries, size_t entryCount)
+{
+    const std::string temporaryPath = std::string(path) + ".tmp";
+    const size_t size = sizeof(Header) + entryCount * sizeof(Entry);
+
+    const int fd = ::open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    bool written(false);
+    if(::ftruncate(fd, static_cast<off_t>(size)) == 0)
+    {
+        void* const mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(mapping != MAP_FAILED)
+        {
+            Header header;
+            header.magic = kMagic;
+            header.version = kVersion;
+            header.entryCount = entryCount;
+            std::memcpy(mapping, &header, sizeof(header));
+            if(entryCount > 0)
+            {
+                std::memcpy(static_cast<char*>(mapping) + sizeof(Header), entries, entryCount * sizeof(Entry));
+            }
+            written = (::msync(mapping, size, MS_SYNC) == 0);
+            ::munmap(mapping, size);
+        }
+    }
+    ::close(fd);
+
+    // Replace the previous snapshot only once the new one is complete
+    if(!written || std::rename(temporaryPath.c_str(), path) != 0)
+    {
+        ::unlink(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+TimerSnapshot::MappedFile::MappedFile(const char* path)
+{
+    const int fd = ::open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return;
+    }
+
+    struct stat status;
+    if(::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Header))
+    {
+        const size_t size = static_cast<size_t>(status.st_size);
+        void* const mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping != MAP_FAILED)
+        {
+            mMapping = mapping;
+            mMappingSize = size;
+
+            Header header;
+            std::memcpy(&header, mapping, sizeof(header));
+            const size_t entryBytes = size - sizeof(Header);
+            if(header.magic == kMagic && header.version >= 1 && header.version <= kVersion && entryBytes / sizeof(Entry) >= header.entryCount)
+            {
+                mVersion = header.version;
+                mEntryCount = static_cast<size_t>(header.entryCount);
+                if(mEntryCount > 0)
+                {
+                    mEntries = reinterpret_cast<const Entry*>(static_cast<const char*>(mapping) + sizeof(Header));
+                }
+            }
+            else
+            {
+                ::munmap(mMapping, mMappingSize);
+                mMapping = nullptr;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+TimerSnapshot::MappedFile::~MappedFile()
+{
+    if(mMapping != nullptr)
+    {
+        ::munmap(mMapping, mMappingSize);
+    }
+}
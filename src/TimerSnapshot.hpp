@@ -0,0 +1,117 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Snapshot file of pending timers, for a fast restart (see BasicTimerScheduler::snapshot/restore).
+//
+// The file is a Header followed by Entry records sorted by remaining time, so that a restore can
+// append them to the queue in order (linear time). It is written and read through mmap.
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+namespace TimerSnapshot
+{
+
+constexpr uint32_t kMagic = 0x53524d54; // "TMRS"
+constexpr uint32_t kVersion = 3; // 2 added the priority, 3 the flags; older files are still read
+
+// Entry flags
+constexpr uint8_t kDormant = 1; // a Manual timer waiting to be rescheduled; its remaining time is 0
+
+struct Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t entryCount;
+};
+
+struct Entry
+{
+    int64_t remainingNanoseconds;
+    int64_t periodNanoseconds;
+    uint64_t callbackKey;
+    int32_t handle;
+    uint32_t group;
+    uint8_t mode;
+    uint8_t jitter;
+    uint8_t priority; // always 0 in version 1 files
+    uint8_t flags;    // always 0 before version 3
+    float jitterFraction;
+};
+
+static_assert(sizeof(Header) == 16, "snapshot header layout");
+static_assert(sizeof(Entry) == 40, "snapshot entry layout");
+
+// Writes a snapshot file (via a temporary file that is renamed over path); returns false on error.
+bool writeFile(const char* path, const Entry* entries, size_t entryCount);
+
+// Read-only mapping of a snapshot file.
+class MappedFile
+{
+public:
+    explicit MappedFile(const char* path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False if the file could not be mapped or is not a valid snapshot
+    bool valid() const { return mEntries != nullptr || (mMapping != nullptr && mEntryCount == 0); }
+    uint32_t version() const { return mVersion; }
+    const Entry* entries() const { return mEntries; }
+    size_t entryCount() const { return mEntryCount; }
+
+private:
+    void* mMapping{nullptr};
+    size_t mMappingSize{0};
+    const Entry* mEntries{nullptr};
+    size_t mEntryCount{0};
+    uint32_t mVersion{0};
+};
+
+} // namespace TimerSnapshot
+
+// Callbacks by key, for re-binding restored timers to their callbacks.
+template<typename Callback>
+class TimerCallbackRegistry
+{
+public:
+    void add(uint64_t key, Callback callback)
+    {
+        mCallbacks[key] = std::move(callback);
+    }
+
+    // Returns nullptr for an unknown key
+    const Callback* find(uint64_t key) const
+    {
+        const auto iter = mCallbacks.find(key);
+        return (iter != mCallbacks.end()) ? &iter->second : nullptr;
+    }
+
+private:
+    std::unordered_map<uint64_t, Callback> mCallbacks;
+};
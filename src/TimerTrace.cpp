@@ -0,0 +1,271 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "TimerTrace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Single-producer (the owning thread) single-consumer (flush) ring of events
+struct Ring
+{
+    explicit Ring(size_t capacity) :
+        events(capacity),
+        mask(capacity - 1)
+    {
+    }
+
+    std::vector<TimerTrace::Event> events;
+    const size_t mask;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    // Cleared when the owning thread exits, so that the ring can be handed to a new thread
+    std::atomic<bool> owned{true};
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    size_t eventsPerThread{65536};
+    std::atomic<uint64_t> droppedEvents{0};
+    // Reference points for calibrating the timestamp rate
+    uint64_t calibrationTimestamp{0};
+    std::chrono::steady_clock::time_point calibrationTime;
+};
+
+Registry& registry()
+{
+    static Registry registry;
+    return registry;
+}
+
+// Gives the calling thread's ring back to the registry when the thread exits
+struct RingOwner
+{
+    ~RingOwner()
+    {
+        if(ring != nullptr)
+        {
+            ring->owned.store(false, std::memory_order_release);
+        }
+    }
+
+    Ring* ring{nullptr};
+};
+
+thread_local RingOwner tRingOwner;
+
+Ring* acquireRing()
+{
+    Registry& traceRegistry = registry();
+    std::lock_guard<std::mutex> lock(traceRegistry.mutex);
+    for(const auto& ring : traceRegistry.rings)
+    {
+        bool expected(false);
+        if(ring->owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+        {
+            return ring.get();
+        }
+    }
+    traceRegistry.rings.push_back(std::make_unique<Ring>(traceRegistry.eventsPerThread));
+    return traceRegistry.rings.back().get();
+}
+
+bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    while(size > 0)
+    {
+        const ssize_t written = ::write(fd, bytes, size);
+        if(written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    while(size > 0)
+    {
+        const ssize_t bytesRead = ::read(fd, bytes, size);
+        if(bytesRead <= 0)
+        {
+            return false;
+        }
+        bytes += bytesRead;
+        size -= static_cast<size_t>(bytesRead);
+    }
+    return true;
+}
+
+} // namespace
+
+
+void TimerTrace::enable(size_t eventsPerThread)
+{
+    Registry& traceRegistry = registry();
+    {
+        std::lock_guard<std::mutex> lock(traceRegistry.mutex);
+        size_t capacity(1);
+        while(capacity < eventsPerThread)
+        {
+            capacity <<= 1;
+        }
+        traceRegistry.eventsPerThread = capacity;
+        if(traceRegistry.calibrationTimestamp == 0)
+        {
+            traceRegistry.calibrationTime = std::chrono::steady_clock::now();
+            traceRegistry.calibrationTimestamp = readTimestamp();
+        }
+    }
+    enabledFlag().store(true, std::memory_order_relaxed);
+}
+
+void TimerTrace::disable()
+{
+    enabledFlag().store(false, std::memory_order_relaxed);
+}
+
+void TimerTrace::recordEvent(TimerTypes::TraceEvent event, TimerTypes::TimerHandle handle, int64_t value, TimerTypes::TimerMode mode)
+{
+    Ring* ring = tRingOwner.ring;
+    if(ring == nullptr)
+    {
+        ring = acquireRing();
+        tRingOwner.ring = ring;
+    }
+
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if(head - ring->tail.load(std::memory_order_acquire) > ring->mask)
+    {
+        registry().droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event& slot = ring->events[head & ring->mask];
+    slot.timestamp = readTimestamp();
+    slot.value = value;
+    slot.handle = handle;
+    slot.type = static_cast<uint8_t>(event);
+    slot.mode = static_cast<uint8_t>(mode);
+    slot.reserved = 0;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool TimerTrace::flush(const char* path)
+{
+    std::vector<Event> events;
+    FileHeader header;
+    header.magic = kMagic;
+    header.version = kVersion;
+    {
+        Registry& traceRegistry = registry();
+        std::lock_guard<std::mutex> lock(traceRegistry.mutex);
+        for(const auto& ring : traceRegistry.rings)
+        {
+            const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            const uint64_t head = ring->head.load(std::memory_order_acquire);
+            for(uint64_t i = tail; i != head; ++i)
+            {
+                events.push_back(ring->events[i & ring->mask]);
+            }
+            ring->tail.store(head, std::memory_order_release);
+        }
+
+        // The longer tracing has run, the better the estimate
+        const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - traceRegistry.calibrationTime).count();
+        const uint64_t elapsedTicks = readTimestamp() - traceRegistry.calibrationTimestamp;
+        header.ticksPerSecond = (elapsedSeconds > 0.0) ? static_cast<uint64_t>(static_cast<double>(elapsedTicks) / elapsedSeconds) : 1000000000;
+    }
+
+    // Each thread's events are in order already; merge them
+    std::stable_sort(events.begin(), events.end(), [](const Event& left, const Event& right)
+    {
+        return left.timestamp < right.timestamp;
+    });
+
+    const int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    bool written(false);
+    struct stat status;
+    if(::fstat(fd, &status) == 0)
+    {
+        FileHeader existingHeader;
+        const bool validFile = (status.st_size == 0) ||
+            (::pread(fd, &existingHeader, sizeof(existingHeader), 0) == static_cast<ssize_t>(sizeof(existingHeader)) &&
+             existingHeader.magic == kMagic && existingHeader.version == kVersion);
+
+        // Append the events, then update the header with the latest calibration
+        written = validFile &&
+            ::lseek(fd, 0, SEEK_END) >= 0 &&
+            (status.st_size != 0 || writeAll(fd, &header, sizeof(header))) &&
+            writeAll(fd, events.data(), events.size() * sizeof(Event)) &&
+            ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    }
+    ::close(fd);
+    return written;
+}
+
+uint64_t TimerTrace::droppedEvents()
+{
+    return registry().droppedEvents.load(std::memory_order_relaxed);
+}
+
+bool TimerTrace::readFile(const char* path, FileHeader& header, std::vector<Event>& events)
+{
+    const int fd = ::open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    bool valid(false);
+    struct stat status;
+    if(::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(FileHeader) &&
+       readAll(fd, &header, sizeof(header)) && header.magic == kMagic && header.version >= 1 && header.version <= kVersion)
+    {
+        events.resize((static_cast<size_t>(status.st_size) - sizeof(FileHeader)) / sizeof(Event));
+        valid = readAll(fd, events.data(), events.size() * sizeof(Event));
+    }
+    ::close(fd);
+    return valid;
+}
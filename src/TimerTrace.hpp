@@ -0,0 +1,124 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Binary trace of scheduler activity, for diagnosing lateness and for replaying production workloads
+// against other queues (see tools/TimerTraceReplay.cpp).
+//
+// RingTracer is a tracer policy for BasicTimerScheduler. While tracing is enabled, every thread that
+// records an event gets its own lock-free ring of fixed-size events stamped with the TSC; flush()
+// drains the rings into a file. When a ring is full, events are dropped (and counted) rather than
+// blocking the scheduler. The file is a FileHeader followed by Events in timestamp order per flush.
+
+#include "TimerTypes.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace TimerTrace
+{
+
+constexpr uint32_t kMagic = 0x54524d54; // "TMRT"
+constexpr uint32_t kVersion = 2; // 2 added Reschedule events; version 1 files are still read
+
+struct FileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // Timestamp ticks per second, calibrated against steady_clock while tracing
+    uint64_t ticksPerSecond;
+};
+
+struct Event
+{
+    uint64_t timestamp;
+    int64_t value; // see TimerTypes::TraceEvent
+    int32_t handle;
+    uint8_t type;  // TimerTypes::TraceEvent
+    uint8_t mode;  // TimerTypes::TimerMode, for Add
+    uint16_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 16, "trace header layout");
+static_assert(sizeof(Event) == 24, "trace event layout");
+
+inline uint64_t readTimestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Start recording; rings created from now on hold eventsPerThread events (rounded up to a power of two).
+void enable(size_t eventsPerThread = 65536);
+
+// Stop recording; events recorded so far can still be flushed.
+void disable();
+
+inline std::atomic<bool>& enabledFlag()
+{
+    static std::atomic<bool> enabled{false};
+    return enabled;
+}
+
+inline bool enabled()
+{
+    return enabledFlag().load(std::memory_order_relaxed);
+}
+
+// Append the events recorded since the last flush to a trace file (created if needed); returns false on error.
+bool flush(const char* path);
+
+// Number of events dropped because a ring was full.
+uint64_t droppedEvents();
+
+// Read a whole trace file; returns false if it is not a valid trace.
+bool readFile(const char* path, FileHeader& header, std::vector<Event>& events);
+
+// Records into the calling thread's ring (out of line, so that the check for tracing inlines alone).
+void recordEvent(TimerTypes::TraceEvent event, TimerTypes::TimerHandle handle, int64_t value, TimerTypes::TimerMode mode);
+
+// Tracer policy for BasicTimerScheduler; costs a relaxed load while tracing is disabled.
+struct RingTracer
+{
+    void record(TimerTypes::TraceEvent event, TimerTypes::TimerHandle handle, int64_t value = 0, TimerTypes::TimerMode mode = TimerTypes::TimerMode::Periodic) const
+    {
+        if(enabled())
+        {
+            recordEvent(event, handle, value, mode);
+        }
+    }
+};
+
+} // namespace TimerTrace
@@ -0,0 +1,158 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Types shared by TimerScheduler and every BasicTimerScheduler instantiation.
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+
+namespace TimerTypes
+{
+
+using TimerHandle = int32_t;
+using TimerGroup = uint32_t;
+
+enum class TimerMode : uint8_t
+{
+    Periodic, // fires every period until removed
+    OneShot,  // fires once, after which it is removed (its handle becomes stale)
+    Backoff,  // retries: fires after the period, then after delays growing by backoffMultiplier up to
+              // backoffCap, until the callback reports success (returns true), maxAttempts is
+              // reached, or it is removed
+    Manual,   // fires once after the period, then stays dormant (its handle stays valid) until it is
+              // re-armed with rescheduleTimer() or removed
+    Calendar  // fires at the wall-clock times of a calendar expression; added with addCalendarTimer()
+};
+
+// Randomization of a timer's intervals, so that timers added together (e.g. for connections opened
+// at once) do not keep firing in the same burst. Applied when the timer is added and on every re-arm.
+// Uniform: each interval is period * (1 + r), r uniform in [-jitterFraction, jitterFraction].
+// Decorrelated: each interval is uniform in [period, min(period * (1 + jitterFraction), 3 * previous
+// interval)]; never shorter than the period (for timers that must not fire early).
+enum class JitterMode : uint8_t
+{
+    None,
+    Uniform,
+    Decorrelated
+};
+
+// Priority class of a timer. Timers that become due in the same pass of the scheduler are dispatched
+// in class order (Critical first), and in deadline order within a class; an executor may also
+// dispatch each class separately (see PriorityLaneExecutor). Lateness is reported per class.
+enum class TimerPriority : uint8_t
+{
+    Critical, // e.g. liveness heartbeats
+    High,
+    Normal,
+    Bulk      // e.g. cache expiry
+};
+
+constexpr size_t kPriorityClasses = 4;
+
+// Options chosen when a timer is added.
+struct TimerOptions
+{
+    // Group (tag) the timer belongs to; 0 means no group. See cancelGroup().
+    TimerGroup group{0};
+    TimerMode mode{TimerMode::Periodic};
+    TimerPriority priority{TimerPriority::Normal};
+    // Identifies the callback in a snapshot (see TimerSnapshot.hpp); 0 means not snapshotted.
+    uint64_t callbackKey{0};
+    JitterMode jitter{JitterMode::None};
+    float jitterFraction{0.0f};
+    // Backoff timers only; jitter applies to each delay
+    float backoffMultiplier{2.0f};
+    std::chrono::nanoseconds backoffCap{0}; // 0 means no cap
+    uint32_t maxAttempts{0};                // 0 means unlimited
+};
+
+// How removeTimer() cancels a timer.
+// Eager: the timer is removed from the queue immediately, under the scheduler's lock.
+// Lazy: the timer is only marked as cancelled, without locking; the scheduler thread drops it
+// when it reaches the head of the queue, or compacts the queue once cancelled timers make up
+// more than the compaction threshold (fraction of queued timers).
+enum class CancelMode
+{
+    Eager,
+    Lazy
+};
+
+// Scheduler activity recorded by a tracer policy (see TimerPolicies.hpp and TimerTrace.hpp).
+enum class TraceEvent : uint8_t
+{
+    Add,    // timer added; value is the period in nanoseconds
+    Cancel, // timer removed (also per timer of a cancelled group)
+    Fire,   // callback about to be invoked
+    Wake,   // scheduler thread woke up; value is the nanoseconds until the deadline it waited for
+            // (negative when it woke late, 0 when it had no deadline)
+    Reschedule // timer's next deadline moved (rescheduleTimer); value is the delay in nanoseconds
+};
+
+// Statistics kept per timer group while the group has timers.
+struct GroupStatistics
+{
+    size_t activeTimers{0};
+    uint64_t addedTimers{0};
+    uint64_t firedCallbacks{0};
+    uint64_t cancelledTimers{0};
+};
+
+// Statistics kept per priority class; lateness is from a timer's deadline to its dispatch.
+struct PriorityStatistics
+{
+    uint64_t firedCallbacks{0};
+    int64_t totalLatenessNanoseconds{0};
+    int64_t maxLatenessNanoseconds{0};
+};
+
+// How stop() ends the scheduler.
+struct StopOptions
+{
+    // Before stopping, keep firing the timers that come due within this grace period (new timers are
+    // refused meanwhile); 0 stops right away
+    std::chrono::nanoseconds drainPeriod{0};
+    // Keep the remaining timers, paused (see pause()), instead of removing them: after run() or start()
+    // they continue from where they stood once resume() is called
+    bool keepTimers{false};
+};
+
+// The scheduler's state as published for observers (see status()), read without taking its lock.
+template<typename TimePoint>
+struct SchedulerStatus
+{
+    bool running{false};
+    // Timers are kept but do not fire (see pause())
+    bool paused{false};
+    // Timers in the queue; lazily cancelled timers count until the scheduler drops them
+    size_t queuedTimers{0};
+    // Deadline of the earliest queued timer (for some queues a lower bound of it), if any
+    std::optional<TimePoint> nextDeadline;
+    // Callbacks fired since the scheduler was started
+    uint64_t firedCallbacks{0};
+};
+
+} // namespace TimerTypes
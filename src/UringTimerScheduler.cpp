@@ -0,0 +1,421 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "UringTimerScheduler.hpp"
+#include "LocalTimerScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Kinds of the scheduler's own entries, in user_data (with the arm's generation in the low bits)
+enum class EntryKind : uint64_t
+{
+    Timeout = 1,
+    TimeoutUpdate = 2,
+    Wakeup = 3
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "ring indices must be plain 32-bit words");
+
+uint64_t userData(EntryKind kind, uint32_t generation)
+{
+    return UringTimerScheduler::kReservedUserData | (static_cast<uint64_t>(kind) << 32) | generation;
+}
+
+EntryKind kindOf(uint64_t userData)
+{
+    return static_cast<EntryKind>((userData & ~UringTimerScheduler::kReservedUserData) >> 32);
+}
+
+uint32_t generationOf(uint64_t userData)
+{
+    return static_cast<uint32_t>(userData);
+}
+
+__kernel_timespec toTimespec(std::chrono::steady_clock::time_point timePoint)
+{
+    const std::chrono::nanoseconds sinceEpoch = timePoint.time_since_epoch();
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch);
+    __kernel_timespec timespec;
+    timespec.tv_sec = seconds.count();
+    timespec.tv_nsec = (sinceEpoch - seconds).count();
+    return timespec;
+}
+
+} // namespace
+
+struct UringTimerScheduler::Impl
+{
+    LocalTimerScheduler<> timers;
+    CompletionHandler completionHandler;
+
+    // The ring (see io_uring_setup(2))
+    int ringFd{-1};
+    void* sqRing{MAP_FAILED};
+    size_t sqRingSize{0};
+    void* cqRing{MAP_FAILED};
+    size_t cqRingSize{0};
+    io_uring_sqe* sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    size_t sqesSize{0};
+    std::atomic<uint32_t>* sqHead{nullptr};
+    std::atomic<uint32_t>* sqTail{nullptr};
+    uint32_t sqMask{0};
+    uint32_t sqEntries{0};
+    uint32_t* sqArray{nullptr};
+    std::atomic<uint32_t>* cqHead{nullptr};
+    std::atomic<uint32_t>* cqTail{nullptr};
+    uint32_t cqMask{0};
+    io_uring_cqe* cqes{nullptr};
+    // Entries acquired, and handed to the kernel
+    uint32_t acquired{0};
+    uint32_t submitted{0};
+
+    // The armed timeout; the timespecs are read by the kernel when the entry is submitted
+    bool timeoutArmed{false};
+    uint32_t timeoutGeneration{0};
+    std::chrono::steady_clock::time_point armedDeadline;
+    __kernel_timespec armSpec{};
+    __kernel_timespec updateSpec{};
+    bool updateSupported{true};
+
+    // Wakeup of the ring by other threads: an eventfd with a read pending on the ring
+    int wakeupFd{-1};
+    bool wakeupArmed{false};
+    uint64_t wakeupValue{0};
+
+    uint64_t enterCalls{0};
+    uint64_t timeoutSubmissions{0};
+
+    explicit Impl(size_t inboxCapacity) :
+        timers(inboxCapacity)
+    {
+    }
+
+    bool setUp(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if(ringFd < 0)
+        {
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if(params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            sqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if(sqRing == MAP_FAILED)
+        {
+            return false;
+        }
+        if(params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            cqRing = sqRing;
+        }
+        else
+        {
+            cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if(cqRing == MAP_FAILED)
+            {
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+        if(sqes == MAP_FAILED)
+        {
+            return false;
+        }
+
+        char* const sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<std::atomic<uint32_t>*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<std::atomic<uint32_t>*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        char* const cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<std::atomic<uint32_t>*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<std::atomic<uint32_t>*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        acquired = sqTail->load(std::memory_order_relaxed);
+        submitted = acquired;
+
+        wakeupFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        return wakeupFd >= 0;
+    }
+
+    ~Impl()
+    {
+        if(sqes != MAP_FAILED)
+        {
+            ::munmap(sqes, sqesSize);
+        }
+        if(cqRing != MAP_FAILED && cqRing != sqRing)
+        {
+            ::munmap(cqRing, cqRingSize);
+        }
+        if(sqRing != MAP_FAILED)
+        {
+            ::munmap(sqRing, sqRingSize);
+        }
+        if(ringFd >= 0)
+        {
+            ::close(ringFd); // the kernel cancels whatever is still pending
+        }
+        if(wakeupFd >= 0)
+        {
+            ::close(wakeupFd);
+        }
+    }
+
+    // Hands the acquired entries to the kernel, and waits for minComplete completions
+    void enter(uint32_t minComplete)
+    {
+        sqTail->store(acquired, std::memory_order_release);
+        const uint32_t toSubmit = acquired - submitted;
+        if(toSubmit == 0 && minComplete == 0)
+        {
+            return;
+        }
+        ++enterCalls;
+        const long result = ::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, minComplete != 0 ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+        if(result > 0)
+        {
+            submitted += static_cast<uint32_t>(result);
+        }
+        // EINTR or EBUSY (completions must be reaped first): runOnce() reaps and tries again next time
+    }
+
+    io_uring_sqe* acquire()
+    {
+        if(acquired - sqHead->load(std::memory_order_acquire) == sqEntries)
+        {
+            enter(0);
+            if(acquired - sqHead->load(std::memory_order_acquire) == sqEntries)
+            {
+                return nullptr;
+            }
+        }
+        const uint32_t index = acquired & sqMask;
+        io_uring_sqe* const sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        ++acquired;
+        return sqe;
+    }
+
+    // Arms the timeout for the next deadline, or moves it earlier
+    void armTimeout()
+    {
+        const std::optional<std::chrono::steady_clock::time_point> next = timers.nextTimeout();
+        if(!next || (timeoutArmed && *next >= armedDeadline))
+        {
+            return; // an armed timeout that is later than needed just completes early
+        }
+
+        io_uring_sqe* const sqe = acquire();
+        if(sqe == nullptr)
+        {
+            return;
+        }
+        if(timeoutArmed && updateSupported)
+        {
+            updateSpec = toTimespec(*next);
+            sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = userData(EntryKind::Timeout, timeoutGeneration);
+            sqe->addr2 = reinterpret_cast<uintptr_t>(&updateSpec);
+            sqe->timeout_flags = IORING_TIMEOUT_UPDATE | IORING_TIMEOUT_ABS;
+            sqe->user_data = userData(EntryKind::TimeoutUpdate, timeoutGeneration);
+        }
+        else
+        {
+            // A timeout still armed without update support completes later, and is then ignored
+            ++timeoutGeneration;
+            armSpec = toTimespec(*next);
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<uintptr_t>(&armSpec);
+            sqe->len = 1;
+            sqe->off = 0; // a pure timeout, not counting other completions
+            sqe->timeout_flags = IORING_TIMEOUT_ABS;
+            sqe->user_data = userData(EntryKind::Timeout, timeoutGeneration);
+        }
+        timeoutArmed = true;
+        armedDeadline = *next;
+        ++timeoutSubmissions;
+    }
+
+    void armWakeup()
+    {
+        if(wakeupArmed)
+        {
+            return;
+        }
+        io_uring_sqe* const sqe = acquire();
+        if(sqe == nullptr)
+        {
+            return;
+        }
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wakeupFd;
+        sqe->addr = reinterpret_cast<uintptr_t>(&wakeupValue);
+        sqe->len = sizeof(wakeupValue);
+        sqe->user_data = userData(EntryKind::Wakeup, 0);
+        wakeupArmed = true;
+    }
+
+    void reap()
+    {
+        uint32_t head = cqHead->load(std::memory_order_relaxed);
+        while(head != cqTail->load(std::memory_order_acquire))
+        {
+            const io_uring_cqe completion = cqes[head & cqMask];
+            ++head;
+            cqHead->store(head, std::memory_order_release);
+
+            if(completion.user_data < kReservedUserData)
+            {
+                if(completionHandler)
+                {
+                    completionHandler(completion);
+                }
+                continue;
+            }
+            switch(kindOf(completion.user_data))
+            {
+            case EntryKind::Timeout:
+                // Expired (-ETIME), or cancelled; a timeout replaced earlier is ignored
+                if(generationOf(completion.user_data) == timeoutGeneration)
+                {
+                    timeoutArmed = false;
+                }
+                break;
+            case EntryKind::TimeoutUpdate:
+                // -ENOENT: the timeout completed before the update; -EINVAL: the kernel cannot update
+                // timeouts, so they are replaced instead
+                if(completion.res == -EINVAL)
+                {
+                    updateSupported = false;
+                    timeoutArmed = false;
+                }
+                break;
+            case EntryKind::Wakeup:
+                wakeupArmed = false;
+                break;
+            }
+        }
+    }
+};
+
+UringTimerScheduler::UringTimerScheduler(unsigned ringEntries, size_t inboxCapacity) :
+    mImpl(std::make_unique<Impl>(inboxCapacity))
+{
+    if(!mImpl->setUp(ringEntries))
+    {
+        return;
+    }
+    const int wakeupFd = mImpl->wakeupFd;
+    mImpl->timers.setWakeup([wakeupFd]
+    {
+        const uint64_t one = 1;
+        (void)!::write(wakeupFd, &one, sizeof(one));
+    });
+}
+
+UringTimerScheduler::~UringTimerScheduler() = default;
+
+bool UringTimerScheduler::valid() const
+{
+    return mImpl->sqes != MAP_FAILED && mImpl->wakeupFd >= 0;
+}
+
+UringTimerScheduler::TimerHandle UringTimerScheduler::addTimer(const std::chrono::milliseconds& period, TimerCallback callback, const TimerOptions& options)
+{
+    return mImpl->timers.addTimer(period, std::move(callback), options);
+}
+
+void UringTimerScheduler::removeTimer(TimerHandle handle)
+{
+    mImpl->timers.removeTimer(handle);
+}
+
+io_uring_sqe* UringTimerScheduler::acquireSubmission()
+{
+    return valid() ? mImpl->acquire() : nullptr;
+}
+
+void UringTimerScheduler::setCompletionHandler(CompletionHandler handler)
+{
+    mImpl->completionHandler = std::move(handler);
+}
+
+size_t UringTimerScheduler::runOnce()
+{
+    if(!valid())
+    {
+        return 0;
+    }
+    Impl& impl = *mImpl;
+
+    // Commands forwarded before (and timers due by) now
+    size_t firedCallbacks = impl.timers.poll();
+
+    impl.armTimeout();
+    impl.armWakeup();
+    // Do not block if completions are already waiting
+    const bool completionsPending = impl.cqHead->load(std::memory_order_relaxed) != impl.cqTail->load(std::memory_order_acquire);
+    impl.enter(completionsPending ? 0 : 1);
+    impl.reap();
+
+    firedCallbacks += impl.timers.poll();
+    return firedCallbacks;
+}
+
+uint64_t UringTimerScheduler::enterCalls() const
+{
+    return mImpl->enterCalls;
+}
+
+uint64_t UringTimerScheduler::timeoutSubmissions() const
+{
+    return mImpl->timeoutSubmissions;
+}
@@ -0,0 +1,103 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "TimerTypes.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// Timer scheduler for io_uring event loops (Linux 5.11 or later): the timers are driven by a single
+// IORING_OP_TIMEOUT on a ring of the scheduler's, whose completions the owner's loop reaps together
+// with those of its own I/O, instead of by a scheduler thread that hands expirations over.
+//
+// The timers live in a LocalTimerScheduler (see LocalTimerScheduler.hpp): the owner thread adds and
+// removes timers without synchronization, other threads forward them (waking the ring through an
+// eventfd read). Queue changes cost no system call: runOnce() re-arms the timeout only when the next
+// deadline has moved earlier, by updating it in place (IORING_TIMEOUT_UPDATE), and submits that
+// entry together with the owner's pending I/O in one io_uring_enter. A deadline that moved later is
+// left armed; the timeout then completes early, and is re-armed for the actual next deadline.
+// Deadlines are absolute on CLOCK_MONOTONIC, which std::chrono::steady_clock uses on Linux.
+class UringTimerScheduler
+{
+public:
+    using TimerHandle = TimerTypes::TimerHandle;
+    using TimerCallback = std::function<void(TimerHandle handle)>;
+    using TimerOptions = TimerTypes::TimerOptions;
+    // Handles the completion of an entry the owner submitted through acquireSubmission()
+    using CompletionHandler = std::function<void(const io_uring_cqe& completion)>;
+
+    // user_data values from this bit up are the scheduler's own
+    static constexpr uint64_t kReservedUserData = UINT64_C(1) << 63;
+
+    // Must be constructed on the owner thread. ringEntries is the size of the submission queue;
+    // inboxCapacity is as for LocalTimerScheduler. See valid().
+    explicit UringTimerScheduler(unsigned ringEntries = 256, size_t inboxCapacity = 1024);
+
+    ~UringTimerScheduler();
+
+    UringTimerScheduler(const UringTimerScheduler&) = delete;
+    UringTimerScheduler& operator=(const UringTimerScheduler &) = delete;
+    UringTimerScheduler(UringTimerScheduler &&) = delete;
+    UringTimerScheduler & operator=(UringTimerScheduler &&) = delete;
+
+    // False if the ring could not be set up (e.g. io_uring is not available, or blocked by seccomp)
+    bool valid() const;
+
+    // Add a timer, from any thread; its callback is invoked from runOnce(). Returns 0 on failure.
+    TimerHandle addTimer(const std::chrono::milliseconds& period, TimerCallback callback, const TimerOptions& options = TimerOptions());
+
+    // Remove a timer, from any thread.
+    void removeTimer(TimerHandle handle);
+
+    // Owner thread: a zeroed submission queue entry for the owner's own I/O, submitted by the next
+    // runOnce() (or sooner, if the queue fills up); its user_data must be below kReservedUserData.
+    // Returns nullptr if the queue is full even after submitting.
+    io_uring_sqe* acquireSubmission();
+
+    // Owner thread: set the handler of the completions of the owner's own entries.
+    void setCompletionHandler(CompletionHandler handler);
+
+    // Owner thread: submit the pending entries, wait until something completes (the owner's I/O, the
+    // next timer, or a command forwarded by another thread), then handle the completions and fire the
+    // due timers. Returns the number of timer callbacks invoked.
+    size_t runOnce();
+
+    // Owner thread: the number of io_uring_enter calls and of timeout entries (arms and updates)
+    // submitted so far.
+    uint64_t enterCalls() const;
+    uint64_t timeoutSubmissions() const;
+
+private:
+    struct Impl;
+
+    std::unique_ptr<Impl> mImpl;
+};
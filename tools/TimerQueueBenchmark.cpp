@@ -0,0 +1,158 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Benchmarks the queue backends (see src/TimerQueues.hpp) on a large timer population whose
+// deadlines are spread log-uniformly from 1 ms to 1 day, as mixed retry and expiry timers are:
+// fill, cancel a tenth, then fire and re-arm timers in deadline order (the "hold" model).
+//
+//   g++ -std=c++17 -O2 -Isrc tools/TimerQueueBenchmark.cpp -o TimerQueueBenchmark
+//   ./TimerQueueBenchmark [multimap|radix|wheel|tiered|simd] [timers]
+
+#include "TimerQueues.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace
+{
+
+using TimerQueues::Deadline;
+using TimerQueues::Slot;
+
+class DeadlineGenerator
+{
+public:
+    // Nanoseconds from now, log-uniform in [1 ms, 1 day)
+    Deadline next(Deadline now)
+    {
+        return now + static_cast<Deadline>(std::exp(mExponent(mEngine)));
+    }
+
+private:
+    std::mt19937_64 mEngine{42};
+    std::uniform_real_distribution<double> mExponent{std::log(1e6), std::log(86400e9)};
+};
+
+double elapsedNanoseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename Queue>
+void benchmark(const char* name, size_t timers)
+{
+    Queue queue(std::pmr::get_default_resource());
+    DeadlineGenerator deadlines;
+    std::vector<bool> queued(timers, false);
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t slot = 0; slot < timers; ++slot)
+    {
+        queue.push(deadlines.next(0), static_cast<Slot>(slot));
+        queued[slot] = true;
+    }
+    const double pushTime = elapsedNanoseconds(start) / static_cast<double>(timers);
+
+    std::mt19937 engine(7);
+    const size_t cancels = timers / 10;
+    start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < cancels; ++i)
+    {
+        const Slot slot = static_cast<Slot>(engine() % timers);
+        if(queued[slot])
+        {
+            queue.erase(slot);
+            queued[slot] = false;
+        }
+    }
+    const double eraseTime = elapsedNanoseconds(start) / static_cast<double>(cancels);
+
+    // Fire timers in deadline order and re-arm each, until as many have fired as there are timers
+    std::vector<Slot> fired;
+    Deadline now(0);
+    size_t holds(0);
+    start = std::chrono::steady_clock::now();
+    while(holds < timers && !queue.empty())
+    {
+        now = std::max(now, queue.topDeadline());
+        fired.clear();
+        queue.popExpired(now, [&fired](Slot slot, Deadline) { fired.push_back(slot); });
+        for(const Slot slot : fired)
+        {
+            queue.push(deadlines.next(now), slot);
+        }
+        holds += fired.size();
+    }
+    const double holdTime = elapsedNanoseconds(start) / static_cast<double>(holds);
+
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    std::printf("%-9s %zu timers: push %.0f ns, erase %.0f ns, fire+re-arm %.0f ns, peak RSS %ld MB\n",
+                name, timers, pushTime, eraseTime, holdTime, usage.ru_maxrss / 1024);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char* const backend = (argc > 1) ? argv[1] : "radix";
+    const size_t timers = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 10000000;
+
+    // One backend per run, so that the peak RSS is the backend's own
+    if(std::strcmp(backend, "multimap") == 0)
+    {
+        benchmark<TimerQueues::MultimapQueue>("multimap", timers);
+    }
+    else if(std::strcmp(backend, "radix") == 0)
+    {
+        benchmark<TimerQueues::RadixHeapQueue>("radix", timers);
+    }
+    else if(std::strcmp(backend, "wheel") == 0)
+    {
+        benchmark<TimerQueues::TimerWheelQueue<>>("wheel", timers);
+    }
+    else if(std::strcmp(backend, "tiered") == 0)
+    {
+        benchmark<TimerQueues::TieredQueue<>>("tiered", timers);
+    }
+    else if(std::strcmp(backend, "simd") == 0)
+    {
+        std::printf("kernels: %s\n", TimerQueues::SimdKernels::kernels().name);
+        benchmark<TimerQueues::SimdQueue<65536>>("simd", std::min<size_t>(timers, 65536));
+    }
+    else
+    {
+        std::fprintf(stderr, "usage: %s [multimap|radix|wheel|tiered|simd] [timers]\n", argv[0]);
+        return 2;
+    }
+    return 0;
+}
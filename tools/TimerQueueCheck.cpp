@@ -0,0 +1,219 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Checks the queue backends (see src/TimerQueues.hpp) against a std::map of slot -> deadline with
+// random pushes (some of them already overdue), erases and pops, whose deadlines span nanoseconds
+// to days: every pop must output exactly the due entries, in deadline order, and topDeadline()
+// must never be later than the earliest deadline (deadlines rounded up to the resolution of the
+// timing wheel, for it). Prints the first mismatch and exits with 1.
+//
+//   g++ -std=c++17 -O2 -Isrc tools/TimerQueueCheck.cpp -o TimerQueueCheck
+//   ./TimerQueueCheck [all|multimap|radix|wheel|tiered|simd] [operations] [seed]
+
+#include "TimerQueues.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+using TimerQueues::Deadline;
+using TimerQueues::Slot;
+
+constexpr Slot kSlots = 4096;
+
+// The deadline a queue of the given resolution files an entry under
+Deadline roundUp(Deadline deadline, Deadline resolution)
+{
+    return (deadline / resolution + (deadline % resolution > 0 ? 1 : 0)) * resolution;
+}
+
+template<typename Queue>
+bool check(const char* name, size_t operations, uint64_t seed, Deadline resolution = 1)
+{
+    Queue queue(std::pmr::get_default_resource());
+    // Slot -> deadline, as rounded by the queue
+    std::map<Slot, Deadline> reference;
+    std::mt19937_64 engine(seed);
+    Deadline now = 1000000000000LL + static_cast<Deadline>(engine() % 1000000);
+    size_t popped = 0;
+
+    for(size_t operation = 0; operation < operations; ++operation)
+    {
+        const Slot slot = static_cast<Slot>(engine() % kSlots);
+        const unsigned choice = engine() % 10;
+        if(choice < 5)
+        {
+            if(reference.count(slot) != 0)
+            {
+                continue;
+            }
+            // Spread over nanoseconds to days; one in twenty is overdue
+            const Deadline spans[] = {10, 1000, 1000000, 1000000000000LL, 100000000000000LL};
+            Deadline deadline = now + static_cast<Deadline>(engine() % spans[engine() % 5]);
+            if(engine() % 20 == 0)
+            {
+                deadline = now - static_cast<Deadline>(engine() % 1000000);
+            }
+            if(!queue.push(deadline, slot))
+            {
+                std::printf("%s: operation %zu: push of slot %u failed\n", name, operation, slot);
+                return false;
+            }
+            reference.emplace(slot, roundUp(deadline, resolution));
+        }
+        else if(choice < 7)
+        {
+            const auto entry = reference.find(slot);
+            if(entry != reference.end())
+            {
+                queue.erase(slot);
+                reference.erase(entry);
+            }
+        }
+        else
+        {
+            if(!reference.empty())
+            {
+                Deadline earliest = reference.begin()->second;
+                for(const auto& entry : reference)
+                {
+                    earliest = std::min(earliest, entry.second);
+                }
+                if(queue.topDeadline() > earliest)
+                {
+                    std::printf("%s: operation %zu: topDeadline %lld is later than the earliest deadline %lld\n",
+                                name, operation, static_cast<long long>(queue.topDeadline()), static_cast<long long>(earliest));
+                    return false;
+                }
+                if(reference.count(queue.top()) == 0)
+                {
+                    std::printf("%s: operation %zu: top() is slot %u, which is not queued\n", name, operation, queue.top());
+                    return false;
+                }
+                now += static_cast<Deadline>(engine() % ((engine() % 2 == 0) ? 100 : 100000000));
+                if(engine() % 3 == 0)
+                {
+                    now = std::max(now, earliest);
+                }
+            }
+
+            std::vector<std::pair<Deadline, Slot>> output;
+            queue.popExpired(now, [&output](Slot expired, Deadline deadline) { output.emplace_back(deadline, expired); });
+            for(size_t i = 0; i < output.size(); ++i)
+            {
+                const auto entry = reference.find(output[i].second);
+                if(entry == reference.end() || entry->second != roundUp(output[i].first, resolution) || entry->second > now)
+                {
+                    std::printf("%s: operation %zu: popped slot %u at %lld, which is not due at %lld\n",
+                                name, operation, output[i].second, static_cast<long long>(output[i].first), static_cast<long long>(now));
+                    return false;
+                }
+                if(i > 0 && roundUp(output[i].first, resolution) < roundUp(output[i - 1].first, resolution))
+                {
+                    std::printf("%s: operation %zu: popped %lld after %lld\n",
+                                name, operation, static_cast<long long>(output[i].first), static_cast<long long>(output[i - 1].first));
+                    return false;
+                }
+                reference.erase(entry);
+            }
+            for(const auto& entry : reference)
+            {
+                if(entry.second <= now)
+                {
+                    std::printf("%s: operation %zu: slot %u at %lld was not popped at %lld\n",
+                                name, operation, entry.first, static_cast<long long>(entry.second), static_cast<long long>(now));
+                    return false;
+                }
+            }
+            popped += output.size();
+        }
+
+        if(queue.size() != reference.size())
+        {
+            std::printf("%s: operation %zu: size %zu, expected %zu\n", name, operation, queue.size(), reference.size());
+            return false;
+        }
+    }
+
+    size_t visited = 0;
+    queue.forEach([&visited](Slot, Deadline) { ++visited; });
+    if(visited != reference.size())
+    {
+        std::printf("%s: forEach visited %zu entries, expected %zu\n", name, visited, reference.size());
+        return false;
+    }
+    std::printf("%-9s %zu operations, %zu popped: ok\n", name, operations, popped);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char* const backend = (argc > 1) ? argv[1] : "all";
+    const size_t operations = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    const uint64_t seed = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 1;
+    const bool all = std::strcmp(backend, "all") == 0;
+
+    bool known = all;
+    bool ok = true;
+    if(all || std::strcmp(backend, "multimap") == 0)
+    {
+        known = true;
+        ok = check<TimerQueues::MultimapQueue>("multimap", operations, seed) && ok;
+    }
+    if(all || std::strcmp(backend, "radix") == 0)
+    {
+        known = true;
+        ok = check<TimerQueues::RadixHeapQueue>("radix", operations, seed) && ok;
+    }
+    if(all || std::strcmp(backend, "wheel") == 0)
+    {
+        known = true;
+        ok = check<TimerQueues::TimerWheelQueue<>>("wheel", operations, seed, 1000000) && ok;
+    }
+    if(all || std::strcmp(backend, "tiered") == 0)
+    {
+        known = true;
+        ok = check<TimerQueues::TieredQueue<>>("tiered", operations, seed) && ok;
+    }
+    if(all || std::strcmp(backend, "simd") == 0)
+    {
+        known = true;
+        ok = check<TimerQueues::SimdQueue<kSlots>>("simd", operations, seed) && ok;
+    }
+    if(!known)
+    {
+        std::fprintf(stderr, "usage: %s [all|multimap|radix|wheel|tiered|simd] [operations] [seed]\n", argv[0]);
+        return 2;
+    }
+    return ok ? 0 : 1;
+}
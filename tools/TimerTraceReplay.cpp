@@ -0,0 +1,311 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Ben Horowitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Replays a trace recorded with TimerTrace (see src/TimerTrace.hpp) against the queue backends, in
+// simulated time, to compare them on a production workload; also summarizes the lateness observed
+// in the trace itself.
+//
+//   g++ -std=c++17 -O2 -Isrc tools/TimerTraceReplay.cpp src/TimerTrace.cpp src/TimerSnapshot.cpp src/TimerCalendar.cpp -o TimerTraceReplay
+//   ./TimerTraceReplay trace.bin [multimap|heap|wheel|radix|tiered|all]
+
+#include "BasicTimerScheduler.hpp"
+#include "TimerTrace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+using TimerTypes::TimerHandle;
+using TimerTypes::TraceEvent;
+
+// Clock that only moves when the replay moves it
+struct SimulatedClock
+{
+    using rep = int64_t;
+    using period = std::nano;
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<SimulatedClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now()
+    {
+        return time_point(duration(sNow));
+    }
+
+    static int64_t sNow;
+};
+
+int64_t SimulatedClock::sNow = 0;
+
+uint64_t sFiredCallbacks = 0;
+
+void onTimeout(TimerHandle)
+{
+    ++sFiredCallbacks;
+}
+
+template<typename Queue>
+using ReplayScheduler = BasicTimerScheduler<SimulatedClock, Queue, NullLock, void (*)(TimerHandle), InlineCallbackExecutor>;
+
+struct ReplayResult
+{
+    uint64_t operations{0};
+    uint64_t firedCallbacks{0};
+    double seconds{0.0};
+};
+
+// Fire everything due up to time (nanoseconds since the start of the trace)
+template<typename Scheduler>
+void advanceTo(Scheduler& scheduler, int64_t time)
+{
+    while(1)
+    {
+        const auto next = scheduler.nextTimeout();
+        if(!next || next->time_since_epoch().count() > time)
+        {
+            break;
+        }
+        SimulatedClock::sNow = std::max(SimulatedClock::sNow, static_cast<int64_t>(next->time_since_epoch().count()));
+        if(scheduler.processTimeouts() == 0)
+        {
+            // The queue reported a lower bound that does not advance on its own; jump ahead
+            const auto after = scheduler.nextTimeout();
+            if(after && after->time_since_epoch().count() <= SimulatedClock::sNow)
+            {
+                SimulatedClock::sNow = time;
+                scheduler.processTimeouts();
+                break;
+            }
+        }
+    }
+    SimulatedClock::sNow = std::max(SimulatedClock::sNow, time);
+}
+
+template<typename Queue>
+ReplayResult replay(const std::vector<TimerTrace::Event>& events, double nanosecondsPerTick)
+{
+    const auto scheduler = std::make_unique<ReplayScheduler<Queue>>();
+    std::unordered_map<TimerHandle, TimerHandle> handles;
+    ReplayResult result;
+
+    SimulatedClock::sNow = 0;
+    sFiredCallbacks = 0;
+    scheduler->start();
+
+    const auto start = std::chrono::steady_clock::now();
+    for(const TimerTrace::Event& event : events)
+    {
+        const TraceEvent type = static_cast<TraceEvent>(event.type);
+        if(type != TraceEvent::Add && type != TraceEvent::Cancel && type != TraceEvent::Reschedule)
+        {
+            continue;
+        }
+
+        advanceTo(*scheduler, static_cast<int64_t>(static_cast<double>(event.timestamp - events.front().timestamp) * nanosecondsPerTick));
+
+        if(type == TraceEvent::Add)
+        {
+            TimerTypes::TimerOptions options;
+            options.mode = static_cast<TimerTypes::TimerMode>(event.mode);
+            if(options.mode == TimerTypes::TimerMode::Calendar)
+            {
+                options.mode = TimerTypes::TimerMode::OneShot; // only the first wall-clock time is traced
+            }
+            handles[event.handle] = scheduler->addTimer(std::chrono::nanoseconds(event.value), &onTimeout, options);
+        }
+        else if(type == TraceEvent::Reschedule)
+        {
+            const auto handleIter = handles.find(event.handle);
+            if(handleIter != handles.end())
+            {
+                scheduler->rescheduleTimer(handleIter->second, std::chrono::nanoseconds(event.value));
+            }
+        }
+        else
+        {
+            const auto handleIter = handles.find(event.handle);
+            if(handleIter != handles.end())
+            {
+                scheduler->removeTimer(handleIter->second);
+                handles.erase(handleIter);
+            }
+        }
+        ++result.operations;
+    }
+    advanceTo(*scheduler, static_cast<int64_t>(static_cast<double>(events.back().timestamp - events.front().timestamp) * nanosecondsPerTick));
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.firedCallbacks = sFiredCallbacks;
+    return result;
+}
+
+double percentile(std::vector<double>& values, double fraction)
+{
+    if(values.empty())
+    {
+        return 0.0;
+    }
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * static_cast<double>(values.size())));
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+    return values[index];
+}
+
+// Lateness of the callbacks and of the scheduler thread's wakeups, as recorded
+void summarize(const std::vector<TimerTrace::Event>& events, double nanosecondsPerTick)
+{
+    struct Armed
+    {
+        uint64_t deadline;
+        uint64_t period;
+    };
+    std::unordered_map<TimerHandle, Armed> armed;
+    std::vector<double> callbackLateness;
+    std::vector<double> wakeLateness;
+    uint64_t counts[5] = {};
+
+    for(const TimerTrace::Event& event : events)
+    {
+        if(event.type < 5)
+        {
+            ++counts[event.type];
+        }
+        switch(static_cast<TraceEvent>(event.type))
+        {
+        case TraceEvent::Add:
+        {
+            const uint64_t period = static_cast<uint64_t>(static_cast<double>(event.value) / nanosecondsPerTick);
+            armed[event.handle] = Armed{event.timestamp + period, period};
+            break;
+        }
+        case TraceEvent::Cancel:
+            armed.erase(event.handle);
+            break;
+        case TraceEvent::Fire:
+        {
+            const auto armedIter = armed.find(event.handle);
+            if(armedIter != armed.end())
+            {
+                const double lateness = (static_cast<double>(event.timestamp) - static_cast<double>(armedIter->second.deadline)) * nanosecondsPerTick;
+                callbackLateness.push_back(std::max(0.0, lateness) / 1000.0);
+                // periodic timers are re-armed from the time of firing
+                armedIter->second.deadline = event.timestamp + armedIter->second.period;
+            }
+            break;
+        }
+        case TraceEvent::Wake:
+            if(event.value < 0)
+            {
+                wakeLateness.push_back(static_cast<double>(-event.value) / 1000.0);
+            }
+            break;
+        case TraceEvent::Reschedule:
+        {
+            // lateness is measured from the moved deadline
+            const auto armedIter = armed.find(event.handle);
+            if(armedIter != armed.end())
+            {
+                armedIter->second.deadline = event.timestamp + static_cast<uint64_t>(static_cast<double>(event.value) / nanosecondsPerTick);
+            }
+            break;
+        }
+        }
+    }
+
+    std::printf("trace: %llu adds, %llu cancels, %llu fires, %llu wakes, %llu reschedules over %.3f s\n",
+                static_cast<unsigned long long>(counts[0]), static_cast<unsigned long long>(counts[1]),
+                static_cast<unsigned long long>(counts[2]), static_cast<unsigned long long>(counts[3]),
+                static_cast<unsigned long long>(counts[4]),
+                events.empty() ? 0.0 : static_cast<double>(events.back().timestamp - events.front().timestamp) * nanosecondsPerTick / 1e9);
+    std::printf("callback lateness (us): p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+                percentile(callbackLateness, 0.5), percentile(callbackLateness, 0.99),
+                percentile(callbackLateness, 0.999), percentile(callbackLateness, 1.0));
+    std::printf("late wakeups: %zu, lateness (us): p99 %.1f  max %.1f\n",
+                wakeLateness.size(), percentile(wakeLateness, 0.99), percentile(wakeLateness, 1.0));
+}
+
+template<typename Queue>
+void report(const char* name, const std::vector<TimerTrace::Event>& events, double nanosecondsPerTick)
+{
+    const ReplayResult result = replay<Queue>(events, nanosecondsPerTick);
+    std::printf("%-9s %llu operations, %llu callbacks in %.3f ms (%.1f ns per operation)\n", name,
+                static_cast<unsigned long long>(result.operations), static_cast<unsigned long long>(result.firedCallbacks),
+                result.seconds * 1e3, (result.operations > 0) ? result.seconds * 1e9 / static_cast<double>(result.operations) : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s trace [multimap|heap|wheel|radix|tiered|all]\n", argv[0]);
+        return 2;
+    }
+    const char* const backend = (argc > 2) ? argv[2] : "all";
+
+    TimerTrace::FileHeader header;
+    std::vector<TimerTrace::Event> events;
+    if(!TimerTrace::readFile(argv[1], header, events))
+    {
+        std::fprintf(stderr, "%s: not a timer trace\n", argv[1]);
+        return 1;
+    }
+    if(events.empty())
+    {
+        std::printf("trace is empty\n");
+        return 0;
+    }
+    const double nanosecondsPerTick = 1e9 / static_cast<double>(header.ticksPerSecond);
+
+    summarize(events, nanosecondsPerTick);
+
+    const bool all = (std::strcmp(backend, "all") == 0);
+    if(all || std::strcmp(backend, "multimap") == 0)
+    {
+        report<TimerQueues::MultimapQueue>("multimap", events, nanosecondsPerTick);
+    }
+    if(all || std::strcmp(backend, "heap") == 0)
+    {
+        report<TimerQueues::FixedHeapQueue<(1 << 20)>>("heap", events, nanosecondsPerTick);
+    }
+    if(all || std::strcmp(backend, "wheel") == 0)
+    {
+        report<TimerQueues::TimerWheelQueue<>>("wheel", events, nanosecondsPerTick);
+    }
+    if(all || std::strcmp(backend, "radix") == 0)
+    {
+        report<TimerQueues::RadixHeapQueue>("radix", events, nanosecondsPerTick);
+    }
+    if(all || std::strcmp(backend, "tiered") == 0)
+    {
+        report<TimerQueues::TieredQueue<>>("tiered", events, nanosecondsPerTick);
+    }
+    return 0;
+}